@@ -0,0 +1,247 @@
+/*
+ * Multi-Language Quine - benchmark suite
+ *
+ * Measures func::escape on synthetic and real table content,
+ * ReplaceVectorString::retCode per table, CodeObject::returnCode per
+ * section and end-to-end Quine::print per language into /dev/null,
+ * both streamed and from the render cache.
+ * Every measurement reports ns/line and MB/s; --json FILE also writes
+ * the results as JSON so runs can be compared across commits.
+ * With --startup BIN it instead measures cold exec of a generator binary.
+ *
+ * Compile with: g++ -std=gnu++17 -O2 -o bin/render_bench bench/render_bench.cpp
+ * Usage: render_bench [--json FILE] [--min-time SECONDS]
+ */
+#define main quineMain
+#include "../quine_cpp_python_scheme.cpp"
+#undef main
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+int startupBench(const char *bin, int iterations)
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+  char *const args[] = { const_cast<char*>(bin), const_cast<char*>("--cpp"), nullptr };
+
+  long maxRss = 0;
+  auto start = chrono::steady_clock::now();
+  for(int i = 0; i < iterations; i++)
+  {
+    pid_t pid;
+    if(posix_spawn(&pid, bin, &actions, nullptr, args, environ) != 0)
+    {
+      fprintf(stderr, "cannot run %s\n", bin);
+      return 1;
+    }
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    maxRss = max(maxRss, usage.ru_maxrss);
+  }
+  chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+  posix_spawn_file_actions_destroy(&actions);
+
+  printf("%s  %10.2f us/exec  %6ld KiB max RSS\n",
+    bin, elapsed.count() * 1e6 / iterations, maxRss);
+  return 0;
+}
+
+struct Result
+{
+  string    suite;
+  string    name;
+  size_t    lines;
+  size_t    bytes;
+  size_t    iterations;
+  double    ns;
+};
+
+vector<Result>  results;
+double          minTime = 0.2;
+
+// Runs body until at least minTime has passed, doubling the iteration
+// count each round, and records the time per iteration.
+template<class Body>
+void measure(string suite, string name, size_t lines, size_t bytes, Body body)
+{
+  body();
+  size_t iterations = 1;
+  double elapsed = 0;
+  for(;;)
+  {
+    auto start = chrono::steady_clock::now();
+    for(size_t i = 0; i < iterations; i++)
+      body();
+    elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if(elapsed >= minTime)
+      break;
+    iterations *= 2;
+  }
+  double ns = elapsed * 1e9 / iterations;
+  results.push_back(Result { suite, name, lines, bytes, iterations, ns });
+  printf("%-10s %-22s %8zu lines %9zu bytes %10.2f ns/line %9.1f MB/s\n",
+    suite.c_str(), name.c_str(), lines, bytes, ns / max<size_t>(lines, 1), bytes * 1e3 / ns);
+}
+
+size_t countLines(const string &text)
+{
+  size_t n = 0;
+  for(char c : text)
+    n += c == '\n';
+  return n;
+}
+
+bool writeJson(const char *path)
+{
+  FILE *f = fopen(path, "w");
+  if(!f)
+    return false;
+  fprintf(f, "{\n  \"version\": \"%s\",\n  \"benchmarks\": [", version);
+  for(size_t i = 0; i < results.size(); i++)
+  {
+    const Result &r = results[i];
+    fprintf(f, "%s\n    {\"suite\": \"%s\", \"name\": \"%s\", \"lines\": %zu, \"bytes\": %zu, "
+               "\"iterations\": %zu, \"ns\": %.1f, \"ns_per_line\": %.3f, \"mb_per_s\": %.1f}",
+      i ? "," : "", r.suite.c_str(), r.name.c_str(), r.lines, r.bytes,
+      r.iterations, r.ns, r.ns / max<size_t>(r.lines, 1), r.bytes * 1e3 / r.ns);
+  }
+  fprintf(f, "\n  ]\n}\n");
+  return fclose(f) == 0;
+}
+
+void escapeBench()
+{
+  // Printable text with about one quote or backslash per 32 characters,
+  // cut into 80 character lines.
+  string synthetic;
+  srand(1);
+  for(size_t i = 0; i < (1 << 20); i++)
+  {
+    int r = rand() % 64;
+    synthetic += r == 0 ? '"' : r == 1 ? '\\' : char(' ' + 2 + rand() % 90);
+  }
+  vector<string_view> syntheticLines;
+  for(size_t i = 0; i < synthetic.size(); i += 80)
+    syntheticLines.push_back(string_view(synthetic).substr(i, 80));
+
+  vector<string_view> realLines;
+  size_t realBytes = 0;
+  for(const auto &lang : codeTables)
+    for(const Table &t : lang)
+      for(size_t i = 0; i < t.size(); i++)
+      {
+        realLines.push_back(t[i]);
+        realBytes += t[i].size();
+      }
+
+  CountingSink sink;
+  measure("escape", "synthetic", syntheticLines.size(), synthetic.size(), [&]()
+  {
+    for(string_view l : syntheticLines)
+      func::escape(l, sink);
+  });
+  measure("escape", "tables", realLines.size(), realBytes, [&]()
+  {
+    for(string_view l : realLines)
+      func::escape(l, sink);
+  });
+}
+
+void retCodeBench()
+{
+  const char *languages[] = { "CPP", "PYTHON", "SCHEME" };
+  const char *sections[] = { "Pre", "Classes", "Var", "Post" };
+  for(size_t l = 0; l < 3; l++)
+    for(size_t s = 0; s < 4; s++)
+    {
+      string name = string("str") + sections[s] + languages[l];
+      ReplaceVectorString repl(name, codeTables[l][s]);
+      CountingSink size;
+      repl.retCode<Language::CPP>(size);
+      CountingSink sink;
+      measure("retCode", name, codeTables[l][s].size(), size.bytes, [&]() { repl.retCode<Language::CPP>(sink); });
+    }
+}
+
+void returnCodeBench(Quine &q)
+{
+  const char *sections[] = { "pre", "classes", "var", "post" };
+  for(Language l : q.getLanguages())
+    dispatchLanguage(l, [&](auto lang)
+    {
+      constexpr Language L = decltype(lang)::value;
+      for(size_t s = 0; s < 4; s++)
+      {
+        StringSink text;
+        q.section(s).returnCode<L>(text);
+        CountingSink sink;
+        string name = string(LangPolicy<L>::extension) + " " + sections[s];
+        measure("returnCode", name, countLines(text.text), text.text.size(), [&]() { q.section(s).returnCode<L>(sink); });
+      }
+    });
+}
+
+// Quine::print streams through the line cursor until render() has cached
+// the language, so both paths are measured, streamed first.
+void printBench(Quine &q)
+{
+  int fd = open("/dev/null", O_WRONLY);
+  for(Language l : q.getLanguages())
+  {
+    StringSink text;
+    q.renderTo(l, text);
+    string ext(languageExtension(l));
+    BufferedFdSink sink(fd);
+    measure("print", ext + " streamed", countLines(text.text), text.text.size(), [&]() { q.print(l, sink); });
+    q.render(l);
+    measure("print", ext + " cached", countLines(text.text), text.text.size(), [&]() { q.print(l, sink); });
+  }
+  close(fd);
+}
+
+int main(int argc, char const *argv[])
+{
+  if(argc > 2 && !strcmp(argv[1], "--startup"))
+    return startupBench(argv[2], argc > 3 ? atoi(argv[3]) : 500);
+
+  const char *json = nullptr;
+  for(int i = 1; i + 1 < argc; i += 2)
+  {
+    if(!strcmp(argv[i], "--json"))
+      json = argv[i + 1];
+    else if(!strcmp(argv[i], "--min-time"))
+      minTime = atof(argv[i + 1]);
+    else
+    {
+      fprintf(stderr, "usage: %s [--json FILE] [--min-time SECONDS] | --startup BIN [N]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  auto q = Quine(version);
+  q.addLang(Language::CPP,    codeTables[size_t(Language::CPP)]);
+  q.addLang(Language::PYTHON, codeTables[size_t(Language::PYTHON)]);
+  q.addLang(Language::SCHEME, codeTables[size_t(Language::SCHEME)]);
+  q.init();
+
+  escapeBench();
+  retCodeBench();
+  returnCodeBench(q);
+  printBench(q);
+
+  if(json && !writeJson(json))
+  {
+    fprintf(stderr, "cannot write %s\n", json);
+    return 1;
+  }
+  return 0;
+}
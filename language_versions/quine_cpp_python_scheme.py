@@ -2,7 +2,7 @@
 #
 # Multi-Language Quine
 # Author: Nina Alexandra Klama
-# Languages: C++11, Python 2.7, Scheme (Racket)
+# Languages: C++17, Python 2.7, Scheme (Racket)
 #
 
 import argparse
@@ -131,7 +131,7 @@ class Quine:
 
   def init(self):
     replVersion = ReplaceVariableString("###VERSION###", self.version)
-    replVersion.setString("CPP",    "string version = \"", "\";")
+    replVersion.setString("CPP",    "constexpr char version[] = \"", "\";")
     replVersion.setString("PYTHON", "version = \"","\"")
     replVersion.setString("SCHEME", "(define version \"","\")")
     self.COPre.addReplacement(replVersion)
@@ -181,15 +181,52 @@ strPreCPP = [
   "/*",
   " * Multi-Language Quine",
   " * Author: Nina Alexandra Klama",
-  " * Languages: C++11, Python 2.7, Scheme (Racket)",
+  " * Languages: C++17, Python 2.7, Scheme (Racket)",
   " *",
-  " * Compile with: g++ -std=gnu++0x",
+  " * Compile with: g++ -std=gnu++17",
   " */",
   "using namespace std;",
   "",
   "#include <string>",
+  "#include <string_view>",
+  "#include <array>",
+  "#include <algorithm>",
   "#include <vector>",
   "#include <map>",
+  "#include <set>",
+  "#include <memory>",
+  "#include <memory_resource>",
+  "#include <iterator>",
+  "#include <deque>",
+  "#include <atomic>",
+  "#include <chrono>",
+  "#include <mutex>",
+  "#include <shared_mutex>",
+  "#include <thread>",
+  "#include <variant>",
+  "#include <type_traits>",
+  "#include <cerrno>",
+  "#include <climits>",
+  "#include <cstdint>",
+  "#include <cstdio>",
+  "#include <cstdlib>",
+  "#include <cstring>",
+  "#include <fcntl.h>",
+  "#include <sys/mman.h>",
+  "#include <sys/stat.h>",
+  "#include <sys/uio.h>",
+  "#include <unistd.h>",
+  "#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))",
+  "#include <immintrin.h>",
+  "#endif",
+  "#if defined(__linux__) && __has_include(<linux/io_uring.h>)",
+  "#define QUINE_HAVE_IO_URING",
+  "#include <linux/io_uring.h>",
+  "#include <sys/syscall.h>",
+  "#endif",
+  "#ifdef __linux__",
+  "#include <sys/sendfile.h>",
+  "#endif",
   "#include <tclap/CmdLine.h>",
   "",
   "enum class Language {",
@@ -200,151 +237,1363 @@ strPreCPP = [
   "",
   "###VERSION###",
   "",
+  "#ifdef QUINE_TRACE",
+  "// Timeline tracing, compiled in with -DQUINE_TRACE. Every thread records",
+  "// finished spans into its own ring buffer, which keeps the newest events.",
+  "// At exit all rings are written as Chrome trace-event JSON to the file",
+  "// named by $QUINE_TRACE_FILE, or quine_trace.json.",
+  "namespace trace",
+  "{",
+  "  struct Event",
+  "  {",
+  "    const char  *name;",
+  "    int64_t      begin;",
+  "    int64_t      end;",
+  "  };",
+  "",
+  "  struct Ring",
+  "  {",
+  "    array<Event, 1 << 14>   events;",
+  "    size_t                  next = 0;",
+  "    Event                   open[64];",
+  "    size_t                  depth = 0;",
+  "    size_t                  tid = 0;",
+  "  };",
+  "",
+  "  inline mutex          registryLock;",
+  "  inline vector<Ring*>  rings;",
+  "  inline set<string>    names;",
+  "  inline const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();",
+  "",
+  "  inline int64_t now()",
+  "  {",
+  "    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();",
+  "  }",
+  "",
+  "  inline void dump()",
+  "  {",
+  "    const char *path = getenv(\"QUINE_TRACE_FILE\");",
+  "    FILE *f = fopen(path ? path : \"quine_trace.json\", \"w\");",
+  "    if(!f)",
+  "      return;",
+  "    lock_guard<mutex> lock(registryLock);",
+  "    const char *sep = \"\\n\";",
+  "    fprintf(f, \"{\\\"traceEvents\\\":[\");",
+  "    for(const Ring *r : rings)",
+  "    {",
+  "      size_t count = min(r->next, r->events.size());",
+  "      for(size_t i = r->next - count; i < r->next; i++)",
+  "      {",
+  "        const Event &e = r->events[i % r->events.size()];",
+  "        fprintf(f, \"%s{\\\"name\\\":\\\"%s\\\",\\\"ph\\\":\\\"X\\\",\\\"pid\\\":1,\\\"tid\\\":%zu,\\\"ts\\\":%.3f,\\\"dur\\\":%.3f}\",",
+  "                sep, e.name, r->tid, e.begin / 1e3, (e.end - e.begin) / 1e3);",
+  "        sep = \",\\n\";",
+  "      }",
+  "    }",
+  "    fprintf(f, \"\\n]}\\n\");",
+  "    fclose(f);",
+  "  }",
+  "",
+  "  // Rings are never freed, so dump() still sees those of finished threads.",
+  "  inline Ring &ring()",
+  "  {",
+  "    thread_local Ring *r = nullptr;",
+  "    if(!r)",
+  "    {",
+  "      r = new Ring();",
+  "      lock_guard<mutex> lock(registryLock);",
+  "      if(rings.empty())",
+  "        atexit(dump);",
+  "      rings.push_back(r);",
+  "      r->tid = rings.size();",
+  "    }",
+  "    return *r;",
+  "  }",
+  "",
+  "  // Span names must outlive the program; intern() makes a stable copy.",
+  "  inline const char *intern(const string &name)",
+  "  {",
+  "    lock_guard<mutex> lock(registryLock);",
+  "    return names.insert(name).first->c_str();",
+  "  }",
+  "",
+  "  inline void begin(const char *name)",
+  "  {",
+  "    Ring &r = ring();",
+  "    if(r.depth < size(r.open))",
+  "      r.open[r.depth] = Event { name, now(), 0 };",
+  "    r.depth++;",
+  "  }",
+  "",
+  "  inline void end()",
+  "  {",
+  "    Ring &r = ring();",
+  "    if(r.depth == 0 || --r.depth >= size(r.open))",
+  "      return;",
+  "    Event e = r.open[r.depth];",
+  "    e.end = now();",
+  "    r.events[r.next++ % r.events.size()] = e;",
+  "  }",
+  "",
+  "  class Span",
+  "  {",
+  "    public:",
+  "      explicit Span(const char *name) { begin(name); }",
+  "      ~Span() { end(); }",
+  "      Span(const Span &) = delete;",
+  "      Span &operator=(const Span &) = delete;",
+  "  };",
+  "}",
+  "#define QUINE_SPAN(name) trace::Span traceSpan(name)",
+  "#else",
+  "#define QUINE_SPAN(name)",
+  "#endif",
+  "",
   "namespace func",
   "{",
-  "  string escape(Language l, string s)",
+  "  constexpr size_t findSpecialScalar(const char *s, size_t n)",
   "  {",
-  "    string out;",
-  "    for(char c : s)",
+  "    for(size_t i = 0; i < n; i++)",
+  "      if(s[i] == \'\\\"\' || s[i] == \'\\\\\' || s[i] == \'\\\'\')",
+  "        return i;",
+  "    return n;",
+  "  }",
+  "",
+  "#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))",
+  "  __attribute__((target(\"sse2\")))",
+  "  size_t findSpecialSSE2(const char *s, size_t n)",
+  "  {",
+  "    const __m128i dq = _mm_set1_epi8(\'\\\"\');",
+  "    const __m128i bs = _mm_set1_epi8(\'\\\\\');",
+  "    const __m128i sq = _mm_set1_epi8(\'\\\'\');",
+  "    size_t i = 0;",
+  "    for(; i + 16 <= n; i += 16)",
   "    {",
-  "      switch(c)",
+  "      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));",
+  "      __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, dq), _mm_cmpeq_epi8(v, bs)), _mm_cmpeq_epi8(v, sq));",
+  "      int bits = _mm_movemask_epi8(m);",
+  "      if(bits != 0)",
+  "        return i + __builtin_ctz(bits);",
+  "    }",
+  "    return i + findSpecialScalar(s + i, n - i);",
+  "  }",
+  "",
+  "  __attribute__((target(\"avx2\")))",
+  "  size_t findSpecialAVX2(const char *s, size_t n)",
+  "  {",
+  "    const __m256i dq = _mm256_set1_epi8(\'\\\"\');",
+  "    const __m256i bs = _mm256_set1_epi8(\'\\\\\');",
+  "    const __m256i sq = _mm256_set1_epi8(\'\\\'\');",
+  "    size_t i = 0;",
+  "    for(; i + 32 <= n; i += 32)",
+  "    {",
+  "      __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));",
+  "      __m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, dq), _mm256_cmpeq_epi8(v, bs)), _mm256_cmpeq_epi8(v, sq));",
+  "      unsigned bits = _mm256_movemask_epi8(m);",
+  "      if(bits != 0)",
+  "        return i + __builtin_ctz(bits);",
+  "    }",
+  "    // The tail runs legacy SSE code; clear the upper halves first to",
+  "    // avoid the AVX to SSE transition penalty on every short line.",
+  "    _mm256_zeroupper();",
+  "    return i + findSpecialSSE2(s + i, n - i);",
+  "  }",
+  "#endif",
+  "",
+  "  typedef size_t (*FindSpecialFunc)(const char *s, size_t n);",
+  "",
+  "  FindSpecialFunc pickFindSpecial()",
+  "  {",
+  "#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))",
+  "    __builtin_cpu_init();",
+  "    if(__builtin_cpu_supports(\"avx2\"))",
+  "      return findSpecialAVX2;",
+  "    if(__builtin_cpu_supports(\"sse2\"))",
+  "      return findSpecialSSE2;",
+  "#endif",
+  "    return findSpecialScalar;",
+  "  }",
+  "",
+  "  size_t findSpecialRuntime(const char *s, size_t n)",
+  "  {",
+  "    static const FindSpecialFunc impl = pickFindSpecial();",
+  "    return impl(s, n);",
+  "  }",
+  "",
+  "  constexpr size_t findSpecial(const char *s, size_t n)",
+  "  {",
+  "#if defined(__GNUC__)",
+  "    if(!__builtin_is_constant_evaluated())",
+  "      return findSpecialRuntime(s, n);",
+  "#endif",
+  "    return findSpecialScalar(s, n);",
+  "  }",
+  "",
+  "  template<class Sink>",
+  "  constexpr void escape(string_view s, Sink &out)",
+  "  {",
+  "#ifdef QUINE_TRACE",
+  "    // Spans are not literal types, so constexpr code pairs the calls.",
+  "    bool traced = !__builtin_is_constant_evaluated();",
+  "    if(traced)",
+  "      trace::begin(\"func::escape\");",
+  "#endif",
+  "    while(!s.empty())",
+  "    {",
+  "      size_t i = findSpecial(s.data(), s.size());",
+  "      if(i > 0)",
+  "        out.append(s.substr(0, i));",
+  "      if(i == s.size())",
+  "        break;",
+  "      const char *repl = \"\\\\\\\'\";",
+  "      switch(s[i])",
   "      {",
   "        case \'\\\"\':",
-  "          out += \"\\\\\\\"\"; break;",
+  "          repl = \"\\\\\\\"\"; break;",
   "        case \'\\\\\':",
-  "          out += \"\\\\\\\\\"; break;",
-  "        case \'\\\'\':",
-  "          out += \"\\\\\\\'\"; break;",
-  "        default:",
-  "          out += c;",
+  "          repl = \"\\\\\\\\\"; break;",
   "      }",
+  "      out.append(string_view(repl, 2));",
+  "      s.remove_prefix(i + 1);",
   "    }",
-  "    return out;",
+  "#ifdef QUINE_TRACE",
+  "    if(traced)",
+  "      trace::end();",
+  "#endif",
+  "  }",
+  "",
+  "  constexpr size_t escapedSize(string_view s)",
+  "  {",
+  "    size_t n = s.size();",
+  "    while(!s.empty())",
+  "    {",
+  "      size_t i = findSpecial(s.data(), s.size());",
+  "      if(i == s.size())",
+  "        break;",
+  "      n++;",
+  "      s.remove_prefix(i + 1);",
+  "    }",
+  "    return n;",
+  "  }",
+  "",
+  "  bool writeAll(int fd, string_view data)",
+  "  {",
+  "    while(!data.empty())",
+  "    {",
+  "      ssize_t n = write(fd, data.data(), data.size());",
+  "      if(n < 0 && errno == EINTR)",
+  "        continue;",
+  "      if(n <= 0)",
+  "        return false;",
+  "      data.remove_prefix(n);",
+  "    }",
+  "    return true;",
   "  }",
   "}",
-  ""
-  ]
-
-strClassesCPP = [
-  "class ReplaceObject",
+  "",
+  "// Accounting behind --mem-stats and --stats. Allocations and elapsed",
+  "// time are charged to the innermost phase open on the current thread, so",
+  "// a phase\'s time excludes the phases nested in it. Times of concurrent",
+  "// threads add up.",
+  "namespace stats",
+  "{",
+  "  enum Phase { StaticInit, Setup, Parse, Init, Escape, Pre, Classes, Var, Post, Output, Phases };",
+  "  constexpr const char *phaseNames[Phases] = {",
+  "    \"static init\", \"setup\", \"parse\", \"Quine::init\", \"escape\", \"returnCode pre\",",
+  "    \"returnCode classes\", \"returnCode var\", \"returnCode post\", \"output\"",
+  "  };",
+  "",
+  "  typedef chrono::steady_clock Clock;",
+  "",
+  "  struct Counters",
+  "  {",
+  "    atomic<uint64_t>  allocs;",
+  "    atomic<uint64_t>  bytes;",
+  "    atomic<uint64_t>  nanos;",
+  "  };",
+  "",
+  "  inline Counters                   counters[Phases];",
+  "  inline atomic<int64_t>            live;",
+  "  inline atomic<int64_t>            peak;",
+  "  inline atomic<uint64_t>           emitted;",
+  "  inline thread_local Phase         current = StaticInit;",
+  "  inline thread_local Clock::time_point since;",
+  "  inline const Clock::time_point    processStart = Clock::now();",
+  "",
+  "  // Charges the time since the last switch to the current phase, then",
+  "  // makes p current. A thread\'s first switch only starts its clock.",
+  "  inline void switchTo(Phase p)",
+  "  {",
+  "    Clock::time_point now = Clock::now();",
+  "    if(since != Clock::time_point())",
+  "      counters[current].nanos.fetch_add(chrono::nanoseconds(now - since).count(), memory_order_relaxed);",
+  "    since = now;",
+  "    current = p;",
+  "  }",
+  "",
+  "  // Called first thing in main: everything up to here was static init.",
+  "  inline void enterMain()",
+  "  {",
+  "    since = processStart;",
+  "    switchTo(Setup);",
+  "  }",
+  "",
+  "  class Scope",
+  "  {",
+  "    private:",
+  "      Phase outer;",
+  "    public:",
+  "      explicit Scope(Phase p) : outer(current) { switchTo(p); }",
+  "      ~Scope() { switchTo(outer); }",
+  "      Scope(const Scope &) = delete;",
+  "      Scope &operator=(const Scope &) = delete;",
+  "  };",
+  "",
+  "  // Blocks carry their size in a header so frees can be subtracted from",
+  "  // the live total without relying on sized delete.",
+  "  constexpr size_t header = alignof(max_align_t);",
+  "",
+  "  inline void *allocate(size_t n)",
+  "  {",
+  "    char *p = static_cast<char*>(malloc(n + header));",
+  "    if(!p)",
+  "      return nullptr;",
+  "    *reinterpret_cast<size_t*>(p) = n;",
+  "    counters[current].allocs.fetch_add(1, memory_order_relaxed);",
+  "    counters[current].bytes.fetch_add(n, memory_order_relaxed);",
+  "    int64_t now = live.fetch_add(n, memory_order_relaxed) + n;",
+  "    int64_t top = peak.load(memory_order_relaxed);",
+  "    while(now > top && !peak.compare_exchange_weak(top, now, memory_order_relaxed))",
+  "      ;",
+  "    return p + header;",
+  "  }",
+  "",
+  "  // Not inlined: GCC would otherwise see the free() through the replaced",
+  "  // operator delete and flag it as a mismatched deallocation.",
+  "  __attribute__((noinline)) void release(void *p)",
+  "  {",
+  "    if(!p)",
+  "      return;",
+  "    char *block = static_cast<char*>(p) - header;",
+  "    live.fetch_sub(*reinterpret_cast<size_t*>(block), memory_order_relaxed);",
+  "    free(block);",
+  "  }",
+  "",
+  "  inline void reportMemory()",
+  "  {",
+  "    uint64_t allocs = 0, bytes = 0;",
+  "    for(const Counters &c : counters)",
+  "    {",
+  "      allocs += c.allocs;",
+  "      bytes += c.bytes;",
+  "    }",
+  "    fprintf(stderr, \"mem-stats: %llu allocations, %llu bytes, peak %lld live bytes\\n\",",
+  "            (unsigned long long) allocs, (unsigned long long) bytes, (long long) peak.load());",
+  "    for(size_t p = 0; p < Phases; p++)",
+  "      fprintf(stderr, \"  %-20s %8llu allocations %10llu bytes\\n\", phaseNames[p],",
+  "              (unsigned long long) counters[p].allocs.load(), (unsigned long long) counters[p].bytes.load());",
+  "  }",
+  "",
+  "  inline void reportTiming()",
+  "  {",
+  "    switchTo(current);",
+  "    double total = 0, render = 0;",
+  "    for(size_t p = 0; p < Phases; p++)",
+  "    {",
+  "      double ms = counters[p].nanos / 1e6;",
+  "      total += ms;",
+  "      if(p >= Pre)",
+  "        render += ms;",
+  "    }",
+  "    fprintf(stderr, \"stats: %.3f ms total, %llu bytes in %.3f ms render and output, %.1f MB/s\\n\",",
+  "            total, (unsigned long long) emitted.load(), render, render > 0 ? emitted / render / 1e3 : 0.0);",
+  "    for(size_t p = 0; p < Phases; p++)",
+  "      fprintf(stderr, \"  %-20s %10.3f ms\\n\", phaseNames[p], counters[p].nanos / 1e6);",
+  "  }",
+  "}",
+  "",
+  "// Counting replacements for the global allocation functions. The nothrow",
+  "// and array forms of the library forward to these.",
+  "void *operator new(size_t n)",
+  "{",
+  "  void *p = stats::allocate(n);",
+  "  if(!p)",
+  "    throw bad_alloc();",
+  "  return p;",
+  "}",
+  "void *operator new[](size_t n) { return operator new(n); }",
+  "void operator delete(void *p) noexcept { stats::release(p); }",
+  "void operator delete[](void *p) noexcept { stats::release(p); }",
+  "void operator delete(void *p, size_t) noexcept { stats::release(p); }",
+  "void operator delete[](void *p, size_t) noexcept { stats::release(p); }",
+  "",
+  "struct PoolSpan",
+  "{",
+  "  uint32_t offset;",
+  "  uint32_t length;",
+  "};",
+  "",
+  "class Table",
+  "{",
+  "  private:",
+  "    const char      *pool;",
+  "    const PoolSpan  *spans;",
+  "    size_t           count;",
+  "  public:",
+  "    constexpr Table() : pool(nullptr), spans(nullptr), count(0) {}",
+  "    constexpr Table(const char *p, const PoolSpan *s, size_t n) : pool(p), spans(s), count(n) {}",
+  "    constexpr size_t size() const { return count; }",
+  "    constexpr string_view operator[](size_t i) const",
+  "    {",
+  "      return string_view(pool + spans[i].offset, spans[i].length);",
+  "    }",
+  "};",
+  "",
+  "template<size_t N>",
+  "constexpr size_t tableChars(const string_view (&lines)[N])",
+  "{",
+  "  size_t n = 0;",
+  "  for(string_view l : lines)",
+  "    n += l.size();",
+  "  return n;",
+  "}",
+  "",
+  "template<size_t N>",
+  "constexpr size_t tableLines(const string_view (&)[N]) { return N; }",
+  "",
+  "template<size_t Chars, size_t Lines, size_t Tables>",
+  "class StringPool",
+  "{",
+  "  private:",
+  "    array<char, Chars>          chars {};",
+  "    array<PoolSpan, Lines>      spans {};",
+  "    array<size_t, Tables + 1>   first {};",
+  "  public:",
+  "    template<size_t... N>",
+  "    constexpr StringPool(const string_view (&...tables)[N])",
+  "    {",
+  "      size_t pos = 0, line = 0, t = 0;",
+  "      auto add = [&](const string_view *lines, size_t count)",
+  "      {",
+  "        first[t++] = line;",
+  "        for(size_t i = 0; i < count; i++)",
+  "        {",
+  "          spans[line++] = PoolSpan { uint32_t(pos), uint32_t(lines[i].size()) };",
+  "          for(char c : lines[i])",
+  "            chars[pos++] = c;",
+  "        }",
+  "      };",
+  "      (add(tables, N), ...);",
+  "      first[t] = line;",
+  "    }",
+  "    constexpr Table table(size_t t) const",
+  "    {",
+  "      return Table(chars.data(), spans.data() + first[t], first[t + 1] - first[t]);",
+  "    }",
+  "};",
+  "",
+  "template<const auto &... T>",
+  "constexpr auto makePool()",
+  "{",
+  "  return StringPool<(tableChars(T) + ...), (tableLines(T) + ...), sizeof...(T)>(T...);",
+  "}",
+  "",
+  "template<Language L>",
+  "struct LangPolicy",
+  "{",
+  "  static constexpr string_view quoteOpen  = \"  \\\"\";",
+  "  static constexpr string_view separator  = \"\\\",\\n\";",
+  "  static constexpr string_view lastClose  = \"\\\"\\n\";",
+  "  static constexpr string_view versionOpen  = \"constexpr char version[] = \\\"\";",
+  "  static constexpr string_view versionClose = \"\\\";\";",
+  "  static constexpr string_view extension  = \"cpp\";",
+  "};",
+  "",
+  "template<>",
+  "struct LangPolicy<Language::PYTHON> : LangPolicy<Language::CPP>",
+  "{",
+  "  static constexpr string_view versionOpen  = \"version = \\\"\";",
+  "  static constexpr string_view versionClose = \"\\\"\";",
+  "  static constexpr string_view extension  = \"py\";",
+  "};",
+  "",
+  "template<>",
+  "struct LangPolicy<Language::SCHEME> : LangPolicy<Language::CPP>",
+  "{",
+  "  static constexpr string_view separator  = \"\\\"\\n\";",
+  "  static constexpr string_view versionOpen  = \"(define version \\\"\";",
+  "  static constexpr string_view versionClose = \"\\\")\";",
+  "  static constexpr string_view extension  = \"scm\";",
+  "};",
+  "",
+  "template<Language L, class Sink, class LineFunc>",
+  "constexpr void frameLines(size_t count, Sink &out, LineFunc appendLine)",
+  "{",
+  "  typedef LangPolicy<L> Policy;",
+  "  if(count == 0)",
+  "    return;",
+  "  size_t last = count - 1;",
+  "  for(size_t i = 0; i < last; i++)",
+  "  {",
+  "    out.append(Policy::quoteOpen);",
+  "    appendLine(i);",
+  "    out.append(Policy::separator);",
+  "  }",
+  "  out.append(Policy::quoteOpen);",
+  "  appendLine(last);",
+  "  out.append(Policy::lastClose);",
+  "}",
+  "",
+  "// Bytes frameLines emits around count lines holding chars bytes in total.",
+  "template<Language L>",
+  "constexpr size_t framedSize(size_t count, size_t chars)",
+  "{",
+  "  typedef LangPolicy<L> Policy;",
+  "  if(count == 0)",
+  "    return 0;",
+  "  return chars + count * Policy::quoteOpen.size() + (count - 1) * Policy::separator.size() + Policy::lastClose.size();",
+  "}",
+  "",
+  "template<Language L, class Sink>",
+  "constexpr void quoteLines(const Table &lines, Sink &out)",
+  "{",
+  "  frameLines<L>(lines.size(), out, [&](size_t i) { func::escape(lines[i], out); });",
+  "}",
+  "",
+  "template<class F>",
+  "void dispatchLanguage(Language l, F &&f)",
+  "{",
+  "  switch(l)",
+  "  {",
+  "    case Language::CPP:",
+  "      f(integral_constant<Language, Language::CPP>()); break;",
+  "    case Language::PYTHON:",
+  "      f(integral_constant<Language, Language::PYTHON>()); break;",
+  "    case Language::SCHEME:",
+  "      f(integral_constant<Language, Language::SCHEME>()); break;",
+  "  }",
+  "}",
+  "",
+  "string_view languageExtension(Language l)",
   "{",
+  "  string_view ext;",
+  "  dispatchLanguage(l, [&](auto lang) { ext = LangPolicy<decltype(lang)::value>::extension; });",
+  "  return ext;",
+  "}",
+  "",
+  "class OutputSink",
+  "{",
+  "  public:",
+  "    virtual ~OutputSink() {}",
+  "    virtual void append(string_view s) = 0;",
+  "    virtual void flush() = 0;",
+  "};",
+  "",
+  "class StringSink : public OutputSink",
+  "{",
+  "  public:",
+  "    string text;",
+  "    void append(string_view s)",
+  "    {",
+  "      text.append(s.data(), s.size());",
+  "    }",
+  "    void flush() {}",
+  "};",
+  "",
+  "class CountingSink : public OutputSink",
+  "{",
+  "  public:",
+  "    size_t bytes = 0;",
+  "    void append(string_view s) { bytes += s.size(); }",
+  "    void flush() {}",
+  "};",
+  "",
+  "class MemorySink : public OutputSink",
+  "{",
+  "  private:",
+  "    char    *pos;",
+  "    char    *end;",
+  "    bool     overflow = false;",
+  "  public:",
+  "    MemorySink(char *begin, size_t size) : pos(begin), end(begin + size) {}",
+  "    void append(string_view s)",
+  "    {",
+  "      size_t n = min(s.size(), size_t(end - pos));",
+  "      memcpy(pos, s.data(), n);",
+  "      pos += n;",
+  "      overflow |= n < s.size();",
+  "    }",
+  "    void flush() {}",
+  "    bool filled() const { return pos == end && !overflow; }",
+  "};",
+  "",
+  "// Collects appended data as iovecs pointing at the caller\'s storage and",
+  "// emits it with writev, so appended views must stay valid until flush().",
+  "// Only fragments of up to smallFragment bytes are copied, into a fixed",
+  "// buffer where neighbouring fragments coalesce into one iovec.",
+  "class IovecSink : public OutputSink",
+  "{",
+  "  private:",
+  "    static constexpr size_t smallFragment = 16;",
+  "    int                 fd;",
+  "    vector<iovec>       iov;",
+  "    array<char, 4096>   fragments;",
+  "    size_t              used = 0;",
+  "    bool                failed = false;",
+  "    void push(const char *p, size_t n)",
+  "    {",
+  "      if(!iov.empty() && static_cast<const char*>(iov.back().iov_base) + iov.back().iov_len == p)",
+  "        iov.back().iov_len += n;",
+  "      else",
+  "        iov.push_back(iovec { const_cast<char*>(p), n });",
+  "    }",
+  "    void writeBatch()",
+  "    {",
+  "      size_t i = 0;",
+  "      while(i < iov.size() && !failed)",
+  "      {",
+  "        ssize_t n = writev(fd, iov.data() + i, int(iov.size() - i));",
+  "        if(n < 0 && errno == EINTR)",
+  "          continue;",
+  "        if(n <= 0)",
+  "          failed = true;",
+  "        for(; n > 0; i++)",
+  "        {",
+  "          if(size_t(n) < iov[i].iov_len)",
+  "          {",
+  "            iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + n;",
+  "            iov[i].iov_len -= n;",
+  "            break;",
+  "          }",
+  "          n -= iov[i].iov_len;",
+  "        }",
+  "      }",
+  "      iov.clear();",
+  "      used = 0;",
+  "    }",
+  "  public:",
+  "    IovecSink(int f = STDOUT_FILENO) : fd(f) { iov.reserve(IOV_MAX); }",
+  "    ~IovecSink() { flush(); }",
+  "    void append(string_view s)",
+  "    {",
+  "      if(s.empty())",
+  "        return;",
+  "      if(iov.size() == IOV_MAX)",
+  "        writeBatch();",
+  "      if(s.size() > smallFragment)",
+  "      {",
+  "        push(s.data(), s.size());",
+  "        return;",
+  "      }",
+  "      if(used + s.size() > fragments.size())",
+  "        writeBatch();",
+  "      memcpy(fragments.data() + used, s.data(), s.size());",
+  "      push(fragments.data() + used, s.size());",
+  "      used += s.size();",
+  "    }",
+  "    void flush() { writeBatch(); }",
+  "    bool good() const { return !failed; }",
+  "};",
+  "",
+  "// Forwards only the bytes that fall into [begin, end) of the output,",
+  "// given that the first byte appended sits at offset pos.",
+  "class RangeSink : public OutputSink",
+  "{",
+  "  private:",
+  "    OutputSink  &out;",
+  "    size_t       begin, end, pos;",
+  "  public:",
+  "    RangeSink(OutputSink &o, size_t b, size_t e, size_t p = 0) : out(o), begin(b), end(e), pos(p) {}",
+  "    void append(string_view s)",
+  "    {",
+  "      size_t from = max(pos, begin);",
+  "      size_t to = min(pos + s.size(), end);",
+  "      if(from < to)",
+  "        out.append(s.substr(from - pos, to - from));",
+  "      pos += s.size();",
+  "    }",
+  "    void flush() { out.flush(); }",
+  "};",
+  "",
+  "// Compares the appended stream against expected as it arrives and keeps",
+  "// a 64-bit FNV-1a hash of it, so nothing is materialised. Callers that",
+  "// only need the comparison can turn the hash off.",
+  "class VerifySink : public OutputSink",
+  "{",
+  "  private:",
+  "    string_view   expected;",
+  "    bool          hashed;",
+  "    size_t        pos = 0;",
+  "    size_t        mismatch = string_view::npos;",
+  "    uint64_t      hash = 0xcbf29ce484222325ull;",
+  "  public:",
+  "    explicit VerifySink(string_view e, bool h = true) : expected(e), hashed(h) {}",
+  "    void append(string_view s)",
+  "    {",
+  "      if(hashed)",
+  "        for(unsigned char c : s)",
+  "          hash = (hash ^ c) * 0x100000001b3ull;",
+  "      if(mismatch == string_view::npos)",
+  "      {",
+  "        size_t n = min(s.size(), expected.size() - min(pos, expected.size()));",
+  "        const char *e = expected.data() + min(pos, expected.size());",
+  "        if(n < s.size() || memcmp(s.data(), e, n) != 0)",
+  "        {",
+  "          size_t i = 0;",
+  "          while(i < n && s[i] == e[i])",
+  "            i++;",
+  "          mismatch = pos + i;",
+  "        }",
+  "      }",
+  "      pos += s.size();",
+  "    }",
+  "    void flush() {}",
+  "    // Offset of the first differing byte, counting a length difference",
+  "    // as a difference at the end of the shorter stream; npos if equal.",
+  "    size_t firstMismatch() const",
+  "    {",
+  "      if(mismatch == string_view::npos && pos != expected.size())",
+  "        return min(pos, expected.size());",
+  "      return mismatch;",
+  "    }",
+  "    size_t bytes() const { return pos; }",
+  "    uint64_t digest() const { return hash; }",
+  "};",
+  "",
+  "// Collects output in a fixed 64 KiB buffer and writes it whenever the",
+  "// buffer would overflow, so memory stays bounded whatever the output",
+  "// size. Pieces larger than the buffer are written directly. A failed",
+  "// write sticks until good() is asked.",
+  "class BufferedFdSink : public OutputSink",
+  "{",
+  "  private:",
+  "    static constexpr size_t capacity = 1 << 16;",
+  "    int               fd;",
+  "    unique_ptr<char[]> buffer;",
+  "    size_t            used = 0;",
+  "    bool              failed = false;",
   "  public:",
-  "    virtual vector<string> retCode(Language lang) = 0;",
-  "    virtual string getReplString() = 0;",
+  "    BufferedFdSink(int f = STDOUT_FILENO) : fd(f), buffer(new char[capacity]) {}",
+  "    ~BufferedFdSink() { flush(); }",
+  "    void append(string_view s)",
+  "    {",
+  "      if(used + s.size() > capacity)",
+  "      {",
+  "        flush();",
+  "        if(s.size() > capacity)",
+  "        {",
+  "          failed |= !func::writeAll(fd, s);",
+  "          return;",
+  "        }",
+  "      }",
+  "      memcpy(buffer.get() + used, s.data(), s.size());",
+  "      used += s.size();",
+  "    }",
+  "    void flush()",
+  "    {",
+  "      failed |= !func::writeAll(fd, string_view(buffer.get(), used));",
+  "      used = 0;",
+  "    }",
+  "    bool good() const { return !failed; }",
   "};",
   "",
-  "class ReplaceVectorString : public ReplaceObject",
+  "// Asynchronous writer on top of a raw io_uring. Buffers handed to write()",
+  "// must stay valid until wait() returns. Without io_uring support every",
+  "// write() completes synchronously instead.",
+  "class UringWriter",
   "{",
   "  private:",
-  "    vector<string>  *var;",
-  "    string          replName;",
+  "    struct Request",
+  "    {",
+  "      int         fd;",
+  "      const char *data;",
+  "      size_t      size;",
+  "      int64_t     offset;",
+  "    };",
+  "    deque<Request>  requests;",
+  "    unsigned        inFlight = 0;",
+  "    bool            failed = false;",
+  "    int             ringFd = -1;",
+  "#ifdef QUINE_HAVE_IO_URING",
+  "    unsigned        ringEntries = 0;",
+  "    void           *sqRing = MAP_FAILED, *cqRing = MAP_FAILED;",
+  "    size_t          sqRingSize = 0, cqRingSize = 0;",
+  "    io_uring_sqe   *sqes = static_cast<io_uring_sqe*>(MAP_FAILED);",
+  "    unsigned       *sqTail, *sqMask, *sqArray;",
+  "    unsigned       *cqHead, *cqTail, *cqMask;",
+  "    io_uring_cqe   *cqes;",
+  "",
+  "    template<class T>",
+  "    static T *ringField(void *ring, unsigned offset)",
+  "    {",
+  "      return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);",
+  "    }",
+  "    void setup(unsigned entries)",
+  "    {",
+  "      io_uring_params p {};",
+  "      ringFd = syscall(__NR_io_uring_setup, entries, &p);",
+  "      if(ringFd < 0)",
+  "        return;",
+  "      ringEntries = p.sq_entries;",
+  "      sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);",
+  "      cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);",
+  "      bool single = p.features & IORING_FEAT_SINGLE_MMAP;",
+  "      if(single)",
+  "        sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);",
+  "      sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);",
+  "      cqRing = single ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);",
+  "      void *s = mmap(nullptr, p.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);",
+  "      sqes = static_cast<io_uring_sqe*>(s);",
+  "      if(sqRing == MAP_FAILED || cqRing == MAP_FAILED || s == MAP_FAILED)",
+  "      {",
+  "        teardown();",
+  "        return;",
+  "      }",
+  "      sqTail  = ringField<unsigned>(sqRing, p.sq_off.tail);",
+  "      sqMask  = ringField<unsigned>(sqRing, p.sq_off.ring_mask);",
+  "      sqArray = ringField<unsigned>(sqRing, p.sq_off.array);",
+  "      cqHead  = ringField<unsigned>(cqRing, p.cq_off.head);",
+  "      cqTail  = ringField<unsigned>(cqRing, p.cq_off.tail);",
+  "      cqMask  = ringField<unsigned>(cqRing, p.cq_off.ring_mask);",
+  "      cqes    = ringField<io_uring_cqe>(cqRing, p.cq_off.cqes);",
+  "    }",
+  "    void teardown()",
+  "    {",
+  "      if(sqes != MAP_FAILED)",
+  "        munmap(sqes, ringEntries * sizeof(io_uring_sqe));",
+  "      if(cqRing != MAP_FAILED && cqRing != sqRing)",
+  "        munmap(cqRing, cqRingSize);",
+  "      if(sqRing != MAP_FAILED)",
+  "        munmap(sqRing, sqRingSize);",
+  "      sqes = static_cast<io_uring_sqe*>(MAP_FAILED);",
+  "      sqRing = cqRing = MAP_FAILED;",
+  "      if(ringFd >= 0)",
+  "        close(ringFd);",
+  "      ringFd = -1;",
+  "    }",
+  "    void submit(size_t id)",
+  "    {",
+  "      if(inFlight == ringEntries)",
+  "        reap(1);",
+  "      const Request &r = requests[id];",
+  "      unsigned tail = *sqTail;",
+  "      unsigned slot = tail & *sqMask;",
+  "      io_uring_sqe &sqe = sqes[slot];",
+  "      memset(&sqe, 0, sizeof(sqe));",
+  "      sqe.opcode    = IORING_OP_WRITE;",
+  "      sqe.fd        = r.fd;",
+  "      sqe.addr      = reinterpret_cast<uint64_t>(r.data);",
+  "      sqe.len       = r.size;",
+  "      sqe.off       = uint64_t(r.offset);",
+  "      sqe.user_data = id;",
+  "      sqArray[slot] = slot;",
+  "      __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);",
+  "      inFlight++;",
+  "      long submitted;",
+  "      while((submitted = syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, nullptr, 0)) < 0 && errno == EINTR)",
+  "        ;",
+  "      if(submitted < 1)",
+  "      {",
+  "        // The kernel did not take the entry (EAGAIN or EBUSY under",
+  "        // completion pressure, say), so no completion will ever arrive",
+  "        // for it: withdraw it and write synchronously instead.",
+  "        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);",
+  "        inFlight--;",
+  "        failed |= !writeSync(r);",
+  "      }",
+  "    }",
+  "    void reap(unsigned minComplete)",
+  "    {",
+  "      while(syscall(__NR_io_uring_enter, ringFd, 0, minComplete, IORING_ENTER_GETEVENTS, nullptr, 0) < 0",
+  "            && errno == EINTR)",
+  "        ;",
+  "      unsigned head = *cqHead;",
+  "      unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);",
+  "      vector<size_t> retry;",
+  "      for(; head != tail; head++)",
+  "      {",
+  "        const io_uring_cqe &cqe = cqes[head & *cqMask];",
+  "        Request &r = requests[cqe.user_data];",
+  "        inFlight--;",
+  "        if(cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)",
+  "          failed |= !writeSync(r);",
+  "        else if(cqe.res == -EINTR || cqe.res == -EAGAIN)",
+  "          retry.push_back(cqe.user_data);",
+  "        else if(cqe.res <= 0)",
+  "          failed = true;",
+  "        else if(size_t(cqe.res) < r.size)",
+  "        {",
+  "          r.data += cqe.res;",
+  "          r.size -= cqe.res;",
+  "          if(r.offset >= 0)",
+  "            r.offset += cqe.res;",
+  "          retry.push_back(cqe.user_data);",
+  "        }",
+  "      }",
+  "      __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);",
+  "      for(size_t id : retry)",
+  "        submit(id);",
+  "    }",
+  "#endif",
+  "    static bool writeSync(const Request &r)",
+  "    {",
+  "      if(r.offset < 0)",
+  "        return func::writeAll(r.fd, string_view(r.data, r.size));",
+  "      size_t done = 0;",
+  "      while(done < r.size)",
+  "      {",
+  "        ssize_t n = pwrite(r.fd, r.data + done, r.size - done, r.offset + done);",
+  "        if(n < 0 && errno == EINTR)",
+  "          continue;",
+  "        if(n <= 0)",
+  "          return false;",
+  "        done += n;",
+  "      }",
+  "      return true;",
+  "    }",
   "  public:",
-  "    ReplaceVectorString(string name, vector<string> *in) ",
-  "      : var(in), replName(name) {}",
-  "    string getReplString() { return replName; }  ",
-  "    vector<string> retCode(Language lang)",
+  "    UringWriter(unsigned entries = 64)",
   "    {",
-  "      auto ret = vector<string> ();",
+  "#ifdef QUINE_HAVE_IO_URING",
+  "      setup(entries);",
+  "#endif",
+  "    }",
+  "    ~UringWriter()",
+  "    {",
+  "      wait();",
+  "#ifdef QUINE_HAVE_IO_URING",
+  "      teardown();",
+  "#endif",
+  "    }",
+  "    bool isAsync() const { return ringFd >= 0; }",
+  "    // offset -1 writes at the file position, which only pipes and",
+  "    // terminals should need; keep one such write in flight per fd.",
+  "    void write(int fd, string_view data, int64_t offset)",
+  "    {",
+  "      if(data.empty())",
+  "        return;",
+  "      requests.push_back(Request { fd, data.data(), data.size(), offset });",
+  "#ifdef QUINE_HAVE_IO_URING",
+  "      if(isAsync())",
+  "      {",
+  "        submit(requests.size() - 1);",
+  "        return;",
+  "      }",
+  "#endif",
+  "      failed |= !writeSync(requests.back());",
+  "    }",
+  "    bool wait()",
+  "    {",
+  "#ifdef QUINE_HAVE_IO_URING",
+  "      while(isAsync() && inFlight > 0)",
+  "        reap(1);",
+  "#endif",
+  "      requests.clear();",
+  "      bool ok = !failed;",
+  "      failed = false;",
+  "      return ok;",
+  "    }",
+  "};",
   "",
-  "      for(string vLine : *var)",
+  "class UringSink : public OutputSink",
+  "{",
+  "  private:",
+  "    static constexpr size_t chunkSize = 1 << 16;",
+  "    UringWriter    &writer;",
+  "    int             fd;",
+  "    int64_t         offset;",
+  "    deque<string>   chunks;",
+  "    bool            failed = false;",
+  "    void submitChunk()",
+  "    {",
+  "      string &c = chunks.back();",
+  "      if(c.empty())",
+  "        return;",
+  "      if(offset < 0)",
+  "        failed |= !writer.wait();",
+  "      writer.write(fd, c, offset);",
+  "      if(offset >= 0)",
+  "        offset += c.size();",
+  "      chunks.emplace_back();",
+  "      chunks.back().reserve(chunkSize);",
+  "    }",
+  "  public:",
+  "    UringSink(UringWriter &w, int f) : writer(w), fd(f)",
+  "    {",
+  "      off_t pos = lseek(fd, 0, SEEK_CUR);",
+  "      offset = pos < 0 ? -1 : pos;",
+  "      chunks.emplace_back();",
+  "      chunks.back().reserve(chunkSize);",
+  "    }",
+  "    ~UringSink() { flush(); }",
+  "    void append(string_view s)",
+  "    {",
+  "      chunks.back().append(s.data(), s.size());",
+  "      if(chunks.back().size() >= chunkSize)",
+  "        submitChunk();",
+  "    }",
+  "    void flush()",
+  "    {",
+  "      submitChunk();",
+  "      failed |= !writer.wait();",
+  "      if(offset >= 0)",
+  "        lseek(fd, offset, SEEK_SET);",
+  "      chunks.erase(chunks.begin(), chunks.end() - 1);",
+  "    }",
+  "    bool good() const { return !failed; }",
+  "};",
+  ""
+  ]
+
+strClassesCPP = [
+  "class ReplaceVectorString",
+  "{",
+  "  private:",
+  "    Table             var;",
+  "    string            replName;",
+  "    string            escaped;",
+  "    vector<uint32_t>  lineEnds;",
+  "#ifdef QUINE_TRACE",
+  "    // Interned once, as intern() takes the registry lock.",
+  "    const char       *traceName = trace::intern(replName);",
+  "#endif",
+  "  public:",
+  "    // Escaping is the same for every language, so the table is escaped",
+  "    // once here and each render only adds the language\'s framing.",
+  "    ReplaceVectorString(string name, Table in) ",
+  "      : var(in), replName(name)",
+  "    {",
+  "      stats::Scope scope(stats::Escape);",
+  "      lineEnds.reserve(var.size());",
+  "      for(size_t i = 0; i < var.size(); i++)",
+  "      {",
+  "        func::escape(var[i], escaped);",
+  "        lineEnds.push_back(escaped.size());",
+  "      }",
+  "    }",
+  "    const string &getReplString() const { return replName; }  ",
+  "    string_view escapedLine(size_t i) const",
+  "    {",
+  "      size_t begin = i == 0 ? 0 : lineEnds[i - 1];",
+  "      return string_view(escaped).substr(begin, lineEnds[i] - begin);",
+  "    }",
+  "    template<Language L>",
+  "    size_t codeSize() const { return framedSize<L>(lineEnds.size(), escaped.size()); }",
+  "    // Every framed line but the last adds the same number of bytes, so",
+  "    // the offset of line i follows from the escaped line ends alone.",
+  "    template<Language L>",
+  "    size_t lineOffset(size_t i) const",
+  "    {",
+  "      typedef LangPolicy<L> Policy;",
+  "      return i * (Policy::quoteOpen.size() + Policy::separator.size()) + (i == 0 ? 0 : lineEnds[i - 1]);",
+  "    }",
+  "    template<Language L>",
+  "    bool nextLine(size_t i, pmr::string &buffer, string_view &line) const",
+  "    {",
+  "      typedef LangPolicy<L> Policy;",
+  "      if(i >= lineEnds.size())",
+  "        return false;",
+  "      string_view close = i + 1 < lineEnds.size() ? Policy::separator : Policy::lastClose;",
+  "      string_view text = escapedLine(i);",
+  "      size_t n = Policy::quoteOpen.size() + text.size() + close.size() - 1;",
+  "      // The buffer only ever grows, so steady state is three copies.",
+  "      if(buffer.size() < n)",
+  "        buffer.resize(n);",
+  "      char *p = buffer.data();",
+  "      memcpy(p, Policy::quoteOpen.data(), Policy::quoteOpen.size());",
+  "      memcpy(p + Policy::quoteOpen.size(), text.data(), text.size());",
+  "      memcpy(p + Policy::quoteOpen.size() + text.size(), close.data(), close.size() - 1);",
+  "      line = string_view(p, n);",
+  "      return true;",
+  "    }",
+  "    template<Language L>",
+  "    void retRange(OutputSink &out, size_t begin, size_t end)",
+  "    {",
+  "      typedef LangPolicy<L> Policy;",
+  "      size_t lo = 0, hi = lineEnds.size();",
+  "      while(hi - lo > 1)",
+  "      {",
+  "        size_t mid = (lo + hi) / 2;",
+  "        if(lineOffset<L>(mid) <= begin)",
+  "          lo = mid;",
+  "        else",
+  "          hi = mid;",
+  "      }",
+  "      for(size_t i = lo; i < lineEnds.size() && lineOffset<L>(i) < end; i++)",
   "      {",
-  "        string outLine;",
-  "        outLine = \"  \\\"\";",
-  "        outLine += func::escape(lang, vLine);",
-  "        outLine += \"\\\"\";",
-  "        if(lang != Language::SCHEME)",
-  "          outLine += \",\";",
-  "        ret.push_back(outLine);",
+  "        RangeSink clip(out, begin, end, lineOffset<L>(i));",
+  "        clip.append(Policy::quoteOpen);",
+  "        clip.append(escapedLine(i));",
+  "        clip.append(i + 1 < lineEnds.size() ? Policy::separator : Policy::lastClose);",
   "      }",
-  "      if(lang != Language::SCHEME)",
-  "        ret.back() = ret.back().substr(0, ret.back().length()-1);",
-  "      return ret;",
+  "    }",
+  "    template<Language L>",
+  "    void retCode(OutputSink &out)",
+  "    {",
+  "      QUINE_SPAN(traceName);",
+  "      frameLines<L>(lineEnds.size(), out, [&](size_t i) { out.append(escapedLine(i)); });",
   "    }",
   "};",
   "",
-  "class ReplaceVariableString : public ReplaceObject",
+  "class ReplaceVariableString",
   "{",
   "  private:",
   "    map<Language,string>  preString, postString;",
   "    string                *var;",
   "    string                replName;",
+  "#ifdef QUINE_TRACE",
+  "    const char            *traceName = trace::intern(replName);",
+  "#endif",
   "  public:",
   "    ReplaceVariableString(string name, string *v = nullptr) : var(v), replName(name) {}",
-  "    string getReplString() { return replName; }",
-  "    void setString(Language l, string pre, string post)",
+  "    const string &getReplString() const { return replName; }",
+  "    void setString(Language l, string_view pre, string_view post)",
   "    { ",
-  "      preString.insert(pair<Language,string>(l,pre)); ",
-  "      postString.insert(pair<Language,string>(l,post)); ",
+  "      preString.insert(pair<Language,string>(l,string(pre))); ",
+  "      postString.insert(pair<Language,string>(l,string(post))); ",
+  "    }",
+  "    template<Language L>",
+  "    size_t codeSize() const",
+  "    {",
+  "      auto pre = preString.find(L);",
+  "      auto post = postString.find(L);",
+  "      return (pre != preString.end() ? pre->second.size() : 0) + func::escapedSize(*var)",
+  "           + (post != postString.end() ? post->second.size() : 0) + 1;",
+  "    }",
+  "    template<Language L>",
+  "    bool nextLine(size_t i, pmr::string &buffer, string_view &line) const",
+  "    {",
+  "      if(i > 0)",
+  "        return false;",
+  "      auto pre = preString.find(L);",
+  "      auto post = postString.find(L);",
+  "      buffer.clear();",
+  "      if(pre != preString.end())",
+  "        buffer.append(pre->second);",
+  "      func::escape(*var, buffer);",
+  "      if(post != postString.end())",
+  "        buffer.append(post->second);",
+  "      line = buffer;",
+  "      return true;",
   "    }",
-  "    vector<string> retCode(Language lang)",
+  "    template<Language L>",
+  "    void retRange(OutputSink &out, size_t begin, size_t end)",
   "    {",
-  "      auto ret = vector<string> ();",
-  "      string out = \"\";",
-  "      out += preString[lang];",
-  "      out += func::escape(lang, *var);",
-  "      out += postString[lang];",
-  "      ret.push_back(out);",
-  "      return ret;",
+  "      RangeSink clip(out, begin, end);",
+  "      retCode<L>(clip);",
+  "    }",
+  "    template<Language L>",
+  "    void retCode(OutputSink &out)",
+  "    {",
+  "      QUINE_SPAN(traceName);",
+  "      auto pre = preString.find(L);",
+  "      auto post = postString.find(L);",
+  "      if(pre != preString.end())",
+  "        out.append(pre->second);",
+  "      func::escape(*var, out);",
+  "      if(post != postString.end())",
+  "        out.append(post->second);",
+  "      out.append(\"\\n\");",
   "    }",
   "};",
   "",
+  "typedef variant<ReplaceVectorString, ReplaceVariableString> ReplaceObject;",
+  "",
   "class CodeObject",
   "{",
   "  private:",
-  "    map<Language,vector<string>*>       code;",
-  "    map<const string, ReplaceObject*>  *replacements;  ",
-  "  public:",
-  "    CodeObject()",
+  "    static constexpr size_t verbatim = size_t(-1);",
+  "    map<Language,Table>             code;",
+  "    map<Language,vector<size_t>>    index;",
+  "    map<Language,vector<size_t>>    offsets;",
+  "    map<string, size_t, less<>>     replacements;",
+  "    vector<ReplaceObject>           replObjects;",
+  "    size_t                          revision = 0;",
+  "    stats::Phase                    phase;",
+  "    void indexCode(Language lang)",
   "    {",
-  "      replacements = nullptr;",
+  "      const Table &lines = code[lang];",
+  "      vector<size_t> &idx = index[lang];",
+  "      idx.assign(lines.size(), verbatim);",
+  "      for(size_t i = 0; i < lines.size(); i++)",
+  "      {",
+  "        auto m = replacements.find(lines[i]);",
+  "        if(m != replacements.end())",
+  "          idx[i] = m->second;",
+  "      }",
   "    }",
-  "    void addCode(Language lang, vector<string>* codeIn)",
+  "  public:",
+  "    explicit CodeObject(stats::Phase p) : phase(p) {}",
+  "    void addCode(Language lang, Table codeIn)",
   "    { ",
-  "      code.insert( pair<Language,vector<string>*>(lang, codeIn) );",
+  "      if(!code.insert( pair<Language,Table>(lang, codeIn) ).second)",
+  "        return;",
+  "      indexCode(lang);",
+  "      offsets.clear();",
+  "      revision++;",
+  "    }",
+  "    template<Language L>",
+  "    void returnCode(OutputSink &out)",
+  "    {",
+  "      stats::Scope scope(phase);",
+  "      QUINE_SPAN(stats::phaseNames[phase]);",
+  "      auto c = code.find(L);",
+  "      if(c == code.end())",
+  "        return;",
+  "      const Table &lines = c->second;",
+  "      const vector<size_t> &idx = index.find(L)->second;",
+  "      for(size_t i = 0; i < lines.size(); i++)",
+  "      {",
+  "        if(idx[i] == verbatim)",
+  "        {",
+  "          out.append(lines[i]);",
+  "          out.append(\"\\n\");",
+  "        }",
+  "        else",
+  "          visit([&](auto &r) { r.template retCode<L>(out); }, replObjects[idx[i]]);",
+  "      }",
+  "    }",
+  "    template<Language L>",
+  "    size_t codeSize() const",
+  "    {",
+  "      auto c = code.find(L);",
+  "      if(c == code.end())",
+  "        return 0;",
+  "      const Table &lines = c->second;",
+  "      const vector<size_t> &idx = index.find(L)->second;",
+  "      size_t n = 0;",
+  "      for(size_t i = 0; i < lines.size(); i++)",
+  "      {",
+  "        if(idx[i] == verbatim)",
+  "          n += lines[i].size() + 1;",
+  "        else",
+  "          n += visit([](const auto &r) { return r.template codeSize<L>(); }, replObjects[idx[i]]);",
+  "      }",
+  "      return n;",
   "    }",
-  "    vector<string> returnCode(Language lang)",
+  "    // Output offset of every line of the section plus its total size as",
+  "    // the last entry. Built on first use and dropped whenever a line can",
+  "    // change its length.",
+  "    template<Language L>",
+  "    const vector<size_t> &lineOffsets()",
   "    {",
-  "      vector<string> out;",
-  "      auto lines = code[lang];",
-  "      for(string l : *lines)",
+  "      auto o = offsets.find(L);",
+  "      if(o != offsets.end())",
+  "        return o->second;",
+  "      vector<size_t> &off = offsets[L];",
+  "      off.push_back(0);",
+  "      auto c = code.find(L);",
+  "      if(c == code.end())",
+  "        return off;",
+  "      const Table &lines = c->second;",
+  "      const vector<size_t> &idx = index.find(L)->second;",
+  "      for(size_t i = 0; i < lines.size(); i++)",
   "      {",
-  "        if(replacements != nullptr)",
+  "        size_t n = idx[i] == verbatim ? lines[i].size() + 1",
+  "                 : visit([](const auto &r) { return r.template codeSize<L>(); }, replObjects[idx[i]]);",
+  "        off.push_back(off.back() + n);",
+  "      }",
+  "      return off;",
+  "    }",
+  "    void dropOffsets() { offsets.clear(); }",
+  "    // Pull-based walk over the output lines of L, each without its",
+  "    // newline. Only the current line is ever assembled, in a buffer that",
+  "    // is reused from line to line and allocated from mr.",
+  "    template<Language L>",
+  "    class LineCursor",
+  "    {",
+  "      private:",
+  "        const CodeObject      *co;",
+  "        const Table           *lines = nullptr;",
+  "        const vector<size_t>  *idx = nullptr;",
+  "        size_t                 line = 0;",
+  "        size_t                 part = 0;",
+  "        pmr::string            buffer;",
+  "      public:",
+  "        explicit LineCursor(const CodeObject &c, pmr::memory_resource *mr = pmr::get_default_resource())",
+  "          : co(&c), buffer(mr)",
+  "        {",
+  "          auto code = c.code.find(L);",
+  "          if(code == c.code.end())",
+  "            return;",
+  "          lines = &code->second;",
+  "          idx = &c.index.find(L)->second;",
+  "        }",
+  "        bool next(string_view &out)",
   "        {",
-  "          bool found = false;",
-  "          for(auto m : *replacements)",
+  "          if(!lines)",
+  "            return false;",
+  "          while(line < lines->size())",
   "          {",
-  "            if(!l.compare(m.first))",
+  "            if((*idx)[line] == verbatim)",
   "            {",
-  "              found = true;",
-  "              vector<string> repl = m.second->retCode(lang);",
-  "              for(auto retStr : repl)",
-  "                out.push_back(retStr);",
+  "              out = (*lines)[line++];",
+  "              return true;",
   "            }",
+  "            if(visit([&](const auto &r) { return r.template nextLine<L>(part, buffer, out); }, co->replObjects[(*idx)[line]]))",
+  "            {",
+  "              part++;",
+  "              return true;",
+  "            }",
+  "            line++;",
+  "            part = 0;",
   "          }",
-  "          if(!found)",
-  "            out.push_back(l);",
+  "          return false;",
+  "        }",
+  "    };",
+  "    // Emits bytes [begin, end) of the section, touching only the lines",
+  "    // that overlap the range. off is what lineOffsets<L>() returned.",
+  "    template<Language L>",
+  "    void returnRange(OutputSink &out, const vector<size_t> &off, size_t begin, size_t end)",
+  "    {",
+  "      if(begin >= end || begin >= off.back())",
+  "        return;",
+  "      const Table &lines = code.find(L)->second;",
+  "      const vector<size_t> &idx = index.find(L)->second;",
+  "      size_t i = upper_bound(off.begin(), off.end(), begin) - off.begin() - 1;",
+  "      for(; i < lines.size() && off[i] < end; i++)",
+  "      {",
+  "        size_t from = begin > off[i] ? begin - off[i] : 0;",
+  "        size_t to = min(end, off[i + 1]) - off[i];",
+  "        if(idx[i] == verbatim)",
+  "        {",
+  "          RangeSink clip(out, from, to);",
+  "          clip.append(lines[i]);",
+  "          clip.append(\"\\n\");",
   "        }",
   "        else",
-  "          out.push_back(l);",
+  "          visit([&](auto &r) { r.template retRange<L>(out, from, to); }, replObjects[idx[i]]);",
   "      }",
-  "      return out;",
-  "    }",
-  "    void addReplacement(ReplaceObject* ro)",
-  "    {",
-  "      string s = ro->getReplString();",
-  "      if(replacements == nullptr)",
-  "        replacements = new map<const string, ReplaceObject*>;",
-  "      replacements->insert(pair<const string, ReplaceObject*>(s, ro));",
   "    }",
-  "    vector<string>* getCode(Language l)",
+  "    void addReplacement(ReplaceObject ro)",
   "    {",
-  "      vector<string> *ret = nullptr;",
-  "      for(auto m : code)",
+  "      const string s = visit([](const auto &r) { return r.getReplString(); }, ro);",
+  "      size_t slot = replObjects.size();",
+  "      if(!replacements.insert(pair<const string, size_t>(s, slot)).second)",
+  "        return;",
+  "      replObjects.push_back(move(ro));",
+  "      offsets.clear();",
+  "      revision++;",
+  "      for(auto &c : code)",
   "      {",
-  "        if(m.first == l)",
-  "          ret = m.second;",
+  "        vector<size_t> &idx = index[c.first];",
+  "        for(size_t i = 0; i < c.second.size(); i++)",
+  "          if(c.second[i] == s)",
+  "            idx[i] = slot;",
   "      }",
-  "      return ret;",
+  "    }",
+  "    size_t getRevision() const { return revision; }",
+  "    vector<Language> getLanguages() const",
+  "    {",
+  "      vector<Language> langs;",
+  "      for(auto &c : code)",
+  "        langs.push_back(c.first);",
+  "      return langs;",
+  "    }",
+  "    Table getCode(Language l)",
+  "    {",
+  "      auto m = code.find(l);",
+  "      return m == code.end() ? Table() : m->second;",
   "    }",
   "};",
   "",
@@ -357,140 +1606,875 @@ strClassesCPP = [
   "    CodeObject  COVar;",
   "    CodeObject  COPost;",
   "",
+  "    // Renders read version through the ###VERSION### replacement, so they",
+  "    // hold versionLock shared and setVersion holds it exclusively. The",
+  "    // cache and the line offsets are guarded by renderLock, always taken",
+  "    // after versionLock. Cached strings are shared, so a caller\'s copy",
+  "    // outlives the entry when setVersion drops it.",
+  "    map<Language,shared_ptr<const string>>  rendered;",
+  "    size_t                renderedRevision = 0;",
+  "    size_t                cacheGeneration = 0;",
+  "    mutex                 renderLock;",
+  "    mutable shared_mutex  versionLock;",
+  "    size_t codeRevision() const",
+  "    {",
+  "      return COPre.getRevision() + COClasses.getRevision() + COVar.getRevision() + COPost.getRevision();",
+  "    }",
+  "",
   "  public:",
-  "    Quine(string v) : version(v) {}",
-  "    void addLang(Language l, vector<string> *pre, vector<string> *classes, vector<string> *var, vector<string> *post)",
+  "    Quine(string v)",
+  "      : version(v), COPre(stats::Pre), COClasses(stats::Classes), COVar(stats::Var), COPost(stats::Post) {}",
+  "    string getVersion() const",
+  "    {",
+  "      shared_lock<shared_mutex> reader(versionLock);",
+  "      return version;",
+  "    }",
+  "    void setVersion(string v)",
+  "    {",
+  "      unique_lock<shared_mutex> writer(versionLock);",
+  "      lock_guard<mutex> lock(renderLock);",
+  "      version = v;",
+  "      rendered.clear();",
+  "      cacheGeneration++;",
+  "      COPre.dropOffsets();",
+  "    }",
+  "    vector<Language> getLanguages() const { return COPre.getLanguages(); }",
+  "    // Sections in output order: pre, classes, var, post.",
+  "    CodeObject &section(size_t i)",
+  "    {",
+  "      CodeObject *sections[] = { &COPre, &COClasses, &COVar, &COPost };",
+  "      return *sections[i];",
+  "    }",
+  "    void addLang(Language l, Table pre, Table classes, Table var, Table post)",
   "    {",
   "      COPre.addCode(l,      pre);",
   "      COClasses.addCode(l,  classes);",
   "      COVar.addCode(l,      var);",
   "      COPost.addCode(l,     post);",
   "    }",
+  "    void addLang(Language l, const Table (&code)[4])",
+  "    {",
+  "      addLang(l, code[0], code[1], code[2], code[3]);",
+  "    }",
   "    void init()",
   "    {",
-  "      auto *replVersion = new ReplaceVariableString(\"###VERSION###\", &version);",
-  "      replVersion->setString(Language::CPP,    \"string version = \\\"\", \"\\\";\");",
-  "      replVersion->setString(Language::PYTHON, \"version = \\\"\", \"\\\"\");",
-  "      replVersion->setString(Language::SCHEME, \"(define version \\\"\", \"\\\")\");",
+  "      stats::Scope scope(stats::Init);",
+  "      QUINE_SPAN(\"Quine::init\");",
+  "      ReplaceVariableString replVersion(\"###VERSION###\", &version);",
+  "      replVersion.setString(Language::CPP,    LangPolicy<Language::CPP>::versionOpen,    LangPolicy<Language::CPP>::versionClose);",
+  "      replVersion.setString(Language::PYTHON, LangPolicy<Language::PYTHON>::versionOpen, LangPolicy<Language::PYTHON>::versionClose);",
+  "      replVersion.setString(Language::SCHEME, LangPolicy<Language::SCHEME>::versionOpen, LangPolicy<Language::SCHEME>::versionClose);",
   "      COPre.addReplacement(replVersion);",
   "",
-  "      auto replPreCPP          = new ReplaceVectorString(\"###strPreCPP###\",        COPre.getCode(Language::CPP));",
-  "      auto replClassesCPP      = new ReplaceVectorString(\"###strClassesCPP###\",    COClasses.getCode(Language::CPP));",
-  "      auto replVarCPP          = new ReplaceVectorString(\"###strVarCPP###\",        COVar.getCode(Language::CPP));",
-  "      auto replPostCPP         = new ReplaceVectorString(\"###strPostCPP###\",       COPost.getCode(Language::CPP));",
-  "      auto replPrePYTHON       = new ReplaceVectorString(\"###strPrePYTHON###\",     COPre.getCode(Language::PYTHON));",
-  "      auto replClassesPYTHON   = new ReplaceVectorString(\"###strClassesPYTHON###\", COClasses.getCode(Language::PYTHON));",
-  "      auto replVarPYTHON       = new ReplaceVectorString(\"###strVarPYTHON###\",     COVar.getCode(Language::PYTHON));",
-  "      auto replPostPYTHON      = new ReplaceVectorString(\"###strPostPYTHON###\",    COPost.getCode(Language::PYTHON));",
-  "      auto replPreSCHEME       = new ReplaceVectorString(\"###strPreSCHEME###\",     COPre.getCode(Language::SCHEME));",
-  "      auto replClassesSCHEME   = new ReplaceVectorString(\"###strClassesSCHEME###\", COClasses.getCode(Language::SCHEME));",
-  "      auto replVarSCHEME       = new ReplaceVectorString(\"###strVarSCHEME###\",     COVar.getCode(Language::SCHEME));",
-  "      auto replPostSCHEME      = new ReplaceVectorString(\"###strPostSCHEME###\",    COPost.getCode(Language::SCHEME));",
-  "",
-  "      COVar.addReplacement(replPreCPP);",
-  "      COVar.addReplacement(replClassesCPP);",
-  "      COVar.addReplacement(replVarCPP);",
-  "      COVar.addReplacement(replPostCPP);",
-  "      COVar.addReplacement(replPrePYTHON);",
-  "      COVar.addReplacement(replClassesPYTHON);",
-  "      COVar.addReplacement(replVarPYTHON);",
-  "      COVar.addReplacement(replPostPYTHON);",
-  "      COVar.addReplacement(replPreSCHEME);",
-  "      COVar.addReplacement(replClassesSCHEME);",
-  "      COVar.addReplacement(replVarSCHEME);",
-  "      COVar.addReplacement(replPostSCHEME);",
-  "    }",
-  "    void print(Language l)",
-  "    {",
-  "      for(string c : COPre.returnCode(l))",
-  "        cout << c << endl;",
-  "      for(string c : COClasses.returnCode(l))",
-  "        cout << c << endl;",
-  "      for(string c : COVar.returnCode(l))",
-  "        cout << c << endl;",
-  "      for(string c : COPost.returnCode(l))",
-  "        cout << c << endl;",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strPreCPP###\",        COPre.getCode(Language::CPP)));",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strClassesCPP###\",    COClasses.getCode(Language::CPP)));",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strVarCPP###\",        COVar.getCode(Language::CPP)));",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strPostCPP###\",       COPost.getCode(Language::CPP)));",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strPrePYTHON###\",     COPre.getCode(Language::PYTHON)));",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strClassesPYTHON###\", COClasses.getCode(Language::PYTHON)));",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strVarPYTHON###\",     COVar.getCode(Language::PYTHON)));",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strPostPYTHON###\",    COPost.getCode(Language::PYTHON)));",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strPreSCHEME###\",     COPre.getCode(Language::SCHEME)));",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strClassesSCHEME###\", COClasses.getCode(Language::SCHEME)));",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strVarSCHEME###\",     COVar.getCode(Language::SCHEME)));",
+  "      COVar.addReplacement(ReplaceVectorString(\"###strPostSCHEME###\",    COPost.getCode(Language::SCHEME)));",
+  "    }",
+  "    template<Language L>",
+  "    void printAs(OutputSink &out)",
+  "    {",
+  "      COPre.returnCode<L>(out);",
+  "      COClasses.returnCode<L>(out);",
+  "      COVar.returnCode<L>(out);",
+  "      COPost.returnCode<L>(out);",
+  "    }",
+  "    // Exact number of bytes renderTo emits for l, derived from the line",
+  "    // lengths and escape counts without rendering anything.",
+  "    size_t outputSize(Language l) const",
+  "    {",
+  "      shared_lock<shared_mutex> reader(versionLock);",
+  "      size_t n = 0;",
+  "      dispatchLanguage(l, [&](auto lang)",
+  "      {",
+  "        constexpr Language L = decltype(lang)::value;",
+  "        n = COPre.codeSize<L>() + COClasses.codeSize<L>() + COVar.codeSize<L>() + COPost.codeSize<L>();",
+  "      });",
+  "      return n;",
+  "    }",
+  "    // Single-pass range over the output lines of L, without newlines.",
+  "    // Iterators share their cursor state, as input iterators may.",
+  "    template<Language L>",
+  "    class LineRange",
+  "    {",
+  "      private:",
+  "        struct State",
+  "        {",
+  "          array<CodeObject::LineCursor<L>, 4>  sections;",
+  "          size_t                               current = 0;",
+  "          string_view                          line;",
+  "          bool next()",
+  "          {",
+  "            for(; current < sections.size(); current++)",
+  "              if(sections[current].next(line))",
+  "                return true;",
+  "            return false;",
+  "          }",
+  "        };",
+  "        const Quine           *q;",
+  "        pmr::memory_resource  *mr;",
+  "      public:",
+  "        class iterator",
+  "        {",
+  "          private:",
+  "            shared_ptr<State> state;",
+  "          public:",
+  "            typedef input_iterator_tag  iterator_category;",
+  "            typedef string_view         value_type;",
+  "            typedef ptrdiff_t           difference_type;",
+  "            typedef const string_view  *pointer;",
+  "            typedef const string_view  &reference;",
+  "            iterator() {}",
+  "            explicit iterator(shared_ptr<State> s) : state(move(s)) { ++*this; }",
+  "            reference operator*() const { return state->line; }",
+  "            iterator &operator++()",
+  "            {",
+  "              if(!state->next())",
+  "                state.reset();",
+  "              return *this;",
+  "            }",
+  "            bool operator==(const iterator &o) const { return state == o.state; }",
+  "            bool operator!=(const iterator &o) const { return state != o.state; }",
+  "        };",
+  "        LineRange(const Quine &quine, pmr::memory_resource *m) : q(&quine), mr(m) {}",
+  "        iterator begin() const",
+  "        {",
+  "          return iterator(allocate_shared<State>(pmr::polymorphic_allocator<State>(mr), State { {",
+  "            CodeObject::LineCursor<L>(q->COPre,     mr),",
+  "            CodeObject::LineCursor<L>(q->COClasses, mr),",
+  "            CodeObject::LineCursor<L>(q->COVar,     mr),",
+  "            CodeObject::LineCursor<L>(q->COPost,    mr)",
+  "          } }));",
+  "        }",
+  "        iterator end() const { return iterator(); }",
+  "    };",
+  "    template<Language L>",
+  "    LineRange<L> lines(pmr::memory_resource *mr = pmr::get_default_resource()) const",
+  "    {",
+  "      return LineRange<L>(*this, mr);",
+  "    }",
+  "    // Emits bytes [offset, offset + length) of what renderTo would emit,",
+  "    // at a cost proportional to the range rather than the whole output.",
+  "    // Holds both locks throughout, so setVersion cannot drop the offsets",
+  "    // while the range is being emitted.",
+  "    void renderRange(Language l, size_t offset, size_t length, OutputSink &out)",
+  "    {",
+  "      dispatchLanguage(l, [&](auto lang)",
+  "      {",
+  "        constexpr Language L = decltype(lang)::value;",
+  "        CodeObject *sections[] = { &COPre, &COClasses, &COVar, &COPost };",
+  "        size_t end = length > SIZE_MAX - offset ? SIZE_MAX : offset + length;",
+  "        size_t start = 0;",
+  "        shared_lock<shared_mutex> reader(versionLock);",
+  "        lock_guard<mutex> lock(renderLock);",
+  "        for(CodeObject *s : sections)",
+  "        {",
+  "          const vector<size_t> &off = s->lineOffsets<L>();",
+  "          size_t size = off.back();",
+  "          if(offset < start + size && start < end)",
+  "            s->returnRange<L>(out, off, offset > start ? offset - start : 0, end - start);",
+  "          start += size;",
+  "        }",
+  "      });",
+  "    }",
+  "    void renderTo(Language l, OutputSink &out)",
+  "    {",
+  "      QUINE_SPAN(\"Quine::renderTo\");",
+  "      shared_lock<shared_mutex> reader(versionLock);",
+  "      dispatchLanguage(l, [&](auto lang) { printAs<decltype(lang)::value>(out); });",
+  "    }",
+  "    shared_ptr<const string> render(Language l)",
+  "    {",
+  "      size_t generation;",
+  "      {",
+  "        lock_guard<mutex> lock(renderLock);",
+  "        if(renderedRevision != codeRevision())",
+  "        {",
+  "          rendered.clear();",
+  "          renderedRevision = codeRevision();",
+  "        }",
+  "        auto c = rendered.find(l);",
+  "        if(c != rendered.end())",
+  "          return c->second;",
+  "        generation = cacheGeneration;",
+  "      }",
+  "      StringSink sink;",
+  "      sink.text.reserve(outputSize(l));",
+  "      renderTo(l, sink);",
+  "      auto text = make_shared<const string>(move(sink.text));",
+  "      lock_guard<mutex> lock(renderLock);",
+  "      // A setVersion since the lookup may have made this render stale,",
+  "      // so it is only handed back, never cached.",
+  "      if(generation != cacheGeneration || renderedRevision != codeRevision())",
+  "        return text;",
+  "      return rendered.emplace(l, move(text)).first->second;",
+  "    }",
+  "    // Cached render of l, or nullptr if l was not rendered since the last",
+  "    // change to the code or the version.",
+  "    shared_ptr<const string> cachedRender(Language l)",
+  "    {",
+  "      lock_guard<mutex> lock(renderLock);",
+  "      if(renderedRevision != codeRevision())",
+  "        return nullptr;",
+  "      auto c = rendered.find(l);",
+  "      return c == rendered.end() ? nullptr : c->second;",
+  "    }",
+  "    // Serves the cached render when there is one. Otherwise streams the",
+  "    // output line by line, so memory stays bounded by the longest line",
+  "    // rather than the output size; the cursor state and line buffers live",
+  "    // in an arena on the stack that dies with the call.",
+  "    void print(Language l, OutputSink &out)",
+  "    {",
+  "      QUINE_SPAN(\"Quine::print\");",
+  "      if(shared_ptr<const string> cached = cachedRender(l))",
+  "      {",
+  "        out.append(*cached);",
+  "        out.flush();",
+  "        return;",
+  "      }",
+  "      char scratch[4096];",
+  "      pmr::monotonic_buffer_resource arena(scratch, sizeof(scratch));",
+  "      shared_lock<shared_mutex> reader(versionLock);",
+  "      dispatchLanguage(l, [&](auto lang)",
+  "      {",
+  "        for(string_view line : lines<decltype(lang)::value>(&arena))",
+  "        {",
+  "          out.append(line);",
+  "          out.append(\"\\n\");",
+  "        }",
+  "      });",
+  "      out.flush();",
+  "    }",
+  "    bool print(Language l)",
+  "    {",
+  "      BufferedFdSink out(STDOUT_FILENO);",
+  "      print(l, out);",
+  "      return out.good();",
   "    }",
   "};",
   ""
   ]
 
 strVarCPP = [
-  "vector<string> strPreCPP = {",
+  "constexpr string_view strPreCPP[] = {",
   "###strPreCPP###",
   "};",
   "",
-  "vector<string> strClassesCPP = {",
+  "constexpr string_view strClassesCPP[] = {",
   "###strClassesCPP###",
   "};",
   "",
-  "vector<string> strVarCPP = {",
+  "constexpr string_view strVarCPP[] = {",
   "###strVarCPP###",
   "};",
   "",
-  "vector<string> strPostCPP = {",
+  "constexpr string_view strPostCPP[] = {",
   "###strPostCPP###",
   "};",
   "",
-  "vector<string> strPrePYTHON = {",
+  "constexpr string_view strPrePYTHON[] = {",
   "###strPrePYTHON###",
   "};",
   "",
-  "vector<string> strClassesPYTHON = {",
+  "constexpr string_view strClassesPYTHON[] = {",
   "###strClassesPYTHON###",
   "};",
   "",
-  "vector<string> strVarPYTHON = {",
+  "constexpr string_view strVarPYTHON[] = {",
   "###strVarPYTHON###",
   "};",
   "",
-  "vector<string> strPostPYTHON = {",
+  "constexpr string_view strPostPYTHON[] = {",
   "###strPostPYTHON###",
   "};",
   "",
-  "vector<string> strPreSCHEME = {",
+  "constexpr string_view strPreSCHEME[] = {",
   "###strPreSCHEME###",
   "};",
   "",
-  "vector<string> strClassesSCHEME = {",
+  "constexpr string_view strClassesSCHEME[] = {",
   "###strClassesSCHEME###",
   "};",
   "",
-  "vector<string> strVarSCHEME = {",
+  "constexpr string_view strVarSCHEME[] = {",
   "###strVarSCHEME###",
   "};",
   "",
-  "vector<string> strPostSCHEME = {",
+  "constexpr string_view strPostSCHEME[] = {",
   "###strPostSCHEME###",
   "};",
   ""
   ]
 
 strPostCPP = [
+  "constexpr auto stringPool = makePool<strPreCPP, strClassesCPP, strVarCPP, strPostCPP,",
+  "                                     strPrePYTHON, strClassesPYTHON, strVarPYTHON, strPostPYTHON,",
+  "                                     strPreSCHEME, strClassesSCHEME, strVarSCHEME, strPostSCHEME>();",
+  "",
+  "// Indexed by [Language][section], in the order the tables were pooled.",
+  "constexpr Table codeTables[3][4] = {",
+  "  { stringPool.table(0), stringPool.table(1), stringPool.table(2),  stringPool.table(3) },",
+  "  { stringPool.table(4), stringPool.table(5), stringPool.table(6),  stringPool.table(7) },",
+  "  { stringPool.table(8), stringPool.table(9), stringPool.table(10), stringPool.table(11) }",
+  "};",
+  "",
+  "#ifdef QUINE_STATIC_RENDER",
+  "constexpr string_view staticPlaceholders[3][4] = {",
+  "  { \"###strPreCPP###\",    \"###strClassesCPP###\",    \"###strVarCPP###\",    \"###strPostCPP###\" },",
+  "  { \"###strPrePYTHON###\", \"###strClassesPYTHON###\", \"###strVarPYTHON###\", \"###strPostPYTHON###\" },",
+  "  { \"###strPreSCHEME###\", \"###strClassesSCHEME###\", \"###strVarSCHEME###\", \"###strPostSCHEME###\" }",
+  "};",
+  "",
+  "class SizeWriter",
+  "{",
+  "  public:",
+  "    size_t size = 0;",
+  "    constexpr void append(string_view s) { size += s.size(); }",
+  "};",
+  "",
+  "template<size_t N>",
+  "class ArrayWriter",
+  "{",
+  "  public:",
+  "    array<char, N>  text {};",
+  "    size_t          pos = 0;",
+  "    constexpr void append(string_view s)",
+  "    {",
+  "      for(char c : s)",
+  "        text[pos++] = c;",
+  "    }",
+  "};",
+  "",
+  "// Mirrors Quine::init: the version is only replaced in the pre section,",
+  "// the embedded tables only in the var section.",
+  "template<Language L, class Writer>",
+  "constexpr void staticRender(Writer &out)",
+  "{",
+  "  typedef LangPolicy<L> Policy;",
+  "  const Table *sections = codeTables[size_t(L)];",
+  "  for(size_t s = 0; s < 4; s++)",
+  "  {",
+  "    for(size_t i = 0; i < sections[s].size(); i++)",
+  "    {",
+  "      string_view line = sections[s][i];",
+  "      const Table *repl = nullptr;",
+  "      for(size_t p = 0; s == 2 && p < 12; p++)",
+  "        if(line == staticPlaceholders[p / 4][p % 4])",
+  "          repl = &codeTables[p / 4][p % 4];",
+  "      if(s == 0 && line == \"###VERSION###\")",
+  "      {",
+  "        out.append(Policy::versionOpen);",
+  "        func::escape(version, out);",
+  "        out.append(Policy::versionClose);",
+  "        out.append(\"\\n\");",
+  "      }",
+  "      else if(repl != nullptr)",
+  "        quoteLines<L>(*repl, out);",
+  "      else",
+  "      {",
+  "        out.append(line);",
+  "        out.append(\"\\n\");",
+  "      }",
+  "    }",
+  "  }",
+  "}",
+  "",
+  "template<Language L>",
+  "struct StaticOutput",
+  "{",
+  "  static constexpr size_t size = [] { SizeWriter w; staticRender<L>(w); return w.size; }();",
+  "  static constexpr array<char, size> text = [] { ArrayWriter<size> w; staticRender<L>(w); return w.text; }();",
+  "};",
+  "",
+  "string_view staticOutput(Language l)",
+  "{",
+  "  string_view text;",
+  "  dispatchLanguage(l, [&](auto lang) {",
+  "    typedef StaticOutput<decltype(lang)::value> Output;",
+  "    text = string_view(Output::text.data(), Output::size);",
+  "  });",
+  "  return text;",
+  "}",
+  "#endif",
+  "",
+  "constexpr char outputName[] = \"quine_cpp_python_scheme\";",
+  "",
+  "bool writeFile(const string &path, string_view data)",
+  "{",
+  "  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);",
+  "  if(fd < 0)",
+  "    return false;",
+  "  bool ok = func::writeAll(fd, data);",
+  "  return close(fd) == 0 && ok;",
+  "}",
+  "",
+  "// Renders every language on its own worker and writes it to",
+  "// outDir/outputName.<extension>.",
+  "template<class RenderFunc>",
+  "int printAll(const vector<Language> &langs, const string &outDir, RenderFunc render)",
+  "{",
+  "  atomic<size_t> next(0);",
+  "  atomic<bool>   failed(false);",
+  "  auto worker = [&]()",
+  "  {",
+  "    stats::Scope scope(stats::Output);",
+  "    for(size_t i = next++; i < langs.size(); i = next++)",
+  "    {",
+  "      string path = outDir + \"/\" + outputName + \".\" + string(languageExtension(langs[i]));",
+  "      if(!writeFile(path, render(langs[i])))",
+  "      {",
+  "        cerr << \"error: cannot write \" << path << endl;",
+  "        failed = true;",
+  "      }",
+  "    }",
+  "  };",
+  "  size_t workers = min<size_t>(max(1u, thread::hardware_concurrency()), langs.size());",
+  "  vector<thread> pool;",
+  "  for(size_t t = 1; t < workers; t++)",
+  "    pool.emplace_back(worker);",
+  "  worker();",
+  "  for(thread &t : pool)",
+  "    t.join();",
+  "  return failed ? 1 : 0;",
+  "}",
+  "",
+  "// Same as printAll, but renders on one thread and queues every file on",
+  "// io_uring, so the next language renders while earlier ones are written.",
+  "template<class RenderFunc>",
+  "int printAllUring(const vector<Language> &langs, const string &outDir, RenderFunc render)",
+  "{",
+  "  UringWriter writer;",
+  "  vector<int> fds;",
+  "  bool        failed = false;",
+  "  for(Language l : langs)",
+  "  {",
+  "    string path = outDir + \"/\" + outputName + \".\" + string(languageExtension(l));",
+  "    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);",
+  "    if(fd < 0)",
+  "    {",
+  "      cerr << \"error: cannot write \" << path << endl;",
+  "      failed = true;",
+  "      continue;",
+  "    }",
+  "    fds.push_back(fd);",
+  "    writer.write(fd, render(l), 0);",
+  "  }",
+  "  if(!writer.wait())",
+  "  {",
+  "    cerr << \"error: writing to \" << outDir << \" failed\" << endl;",
+  "    failed = true;",
+  "  }",
+  "  for(int fd : fds)",
+  "    failed |= close(fd) != 0;",
+  "  return failed ? 1 : 0;",
+  "}",
+  "",
+  "// Preallocates exactly size bytes, maps the file and lets fill() render",
+  "// straight into the mapping. Reserving the blocks up front turns a full",
+  "// disk into an error here instead of SIGBUS inside the mapping; only",
+  "// filesystems without fallocate support get a plain, sparse ftruncate.",
+  "// On failure a regular file is removed again rather than left",
+  "// zero-filled or half written.",
+  "template<class FillFunc>",
+  "int printToFile(const string &path, size_t size, FillFunc fill)",
+  "{",
+  "  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);",
+  "  if(fd < 0)",
+  "  {",
+  "    cerr << \"error: cannot write \" << path << endl;",
+  "    return 1;",
+  "  }",
+  "  struct stat st;",
+  "  bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);",
+  "  int err = size > 0 ? posix_fallocate(fd, 0, size) : 0;",
+  "  if(err == EOPNOTSUPP)",
+  "    err = ftruncate(fd, size) == 0 ? 0 : errno;",
+  "  bool ok = err == 0;",
+  "  if(ok && size > 0)",
+  "  {",
+  "    void *map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);",
+  "    ok = map != MAP_FAILED;",
+  "    if(ok)",
+  "    {",
+  "      MemorySink out(static_cast<char*>(map), size);",
+  "      fill(out);",
+  "      ok = out.filled();",
+  "      munmap(map, size);",
+  "    }",
+  "  }",
+  "  ok &= close(fd) == 0;",
+  "  if(!ok)",
+  "  {",
+  "    cerr << \"error: writing \" << path << \" failed\" << endl;",
+  "    if(regular)",
+  "      unlink(path.c_str());",
+  "  }",
+  "  return ok ? 0 : 1;",
+  "}",
+  "",
+  "#ifdef __linux__",
+  "// Lends data to a pipe by reference. The pages must stay unchanged until",
+  "// the reader consumed them, which holds for the read-only static image",
+  "// and for a render mapping that is never written again.",
+  "size_t spliceOut(int fd, string_view data)",
+  "{",
+  "  size_t done = 0;",
+  "  while(done < data.size())",
+  "  {",
+  "    iovec iov { const_cast<char*>(data.data() + done), data.size() - done };",
+  "    ssize_t n = vmsplice(fd, &iov, 1, 0);",
+  "    if(n < 0 && errno == EINTR)",
+  "      continue;",
+  "    if(n <= 0)",
+  "      break;",
+  "    done += n;",
+  "  }",
+  "  return done;",
+  "}",
+  "",
+  "// Copies the first size bytes of src to fd inside the kernel, falling",
+  "// back from copy_file_range to sendfile across file systems.",
+  "size_t copyOut(int src, int fd, size_t size)",
+  "{",
+  "  off_t offset = 0;",
+  "  bool  ranged = true;",
+  "  while(size_t(offset) < size)",
+  "  {",
+  "    ssize_t n = ranged ? copy_file_range(src, &offset, fd, nullptr, size - offset, 0)",
+  "                       : sendfile(fd, src, &offset, size - offset);",
+  "    if(n < 0 && errno == EINTR)",
+  "      continue;",
+  "    if(n < 0 && ranged && errno != EIO && errno != ENOSPC)",
+  "    {",
+  "      ranged = false;",
+  "      continue;",
+  "    }",
+  "    if(n <= 0)",
+  "      break;",
+  "  }",
+  "  return offset;",
+  "}",
+  "#endif",
+  "",
+  "// Writes data to fd without passing it through write where the kernel",
+  "// allows: vmsplice for pipes and, given a file descriptor src holding the",
+  "// same bytes, copy_file_range or sendfile for regular files.",
+  "bool sendOutput(int fd, string_view data, int src = -1)",
+  "{",
+  "  size_t done = 0;",
+  "#ifdef __linux__",
+  "  struct stat st;",
+  "  if(fstat(fd, &st) == 0)",
+  "  {",
+  "    if(S_ISFIFO(st.st_mode))",
+  "      done = spliceOut(fd, data);",
+  "    else if(S_ISREG(st.st_mode) && src >= 0)",
+  "      done = copyOut(src, fd, data.size());",
+  "  }",
+  "#endif",
+  "  return func::writeAll(fd, data.substr(done));",
+  "}",
+  "",
+  "// Renders into a page-aligned memfd mapping of exactly size bytes and",
+  "// sends it with sendOutput.",
+  "template<class FillFunc>",
+  "int printZeroCopy(int fd, size_t size, FillFunc fill)",
+  "{",
+  "  bool ok = false;",
+  "#ifdef __linux__",
+  "  int src = size > 0 ? memfd_create(outputName, MFD_CLOEXEC) : -1;",
+  "  void *map = MAP_FAILED;",
+  "  if(src >= 0 && ftruncate(src, size) == 0)",
+  "    map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, src, 0);",
+  "  if(map != MAP_FAILED)",
+  "  {",
+  "    MemorySink out(static_cast<char*>(map), size);",
+  "    fill(out);",
+  "    ok = out.filled() && sendOutput(fd, string_view(static_cast<char*>(map), size), src);",
+  "    munmap(map, size);",
+  "    close(src);",
+  "    return ok ? 0 : 1;",
+  "  }",
+  "  if(src >= 0)",
+  "    close(src);",
+  "#endif",
+  "  StringSink out;",
+  "  fill(out);",
+  "  ok = func::writeAll(fd, out.text);",
+  "  return ok ? 0 : 1;",
+  "}",
+  "",
+  "// Parses --range A:B into the half-open byte range [A, B) of an output of",
+  "// total bytes. Either bound may be left out; B is clamped to total.",
+  "bool parseRange(const string &spec, size_t total, size_t &begin, size_t &end)",
+  "{",
+  "  size_t colon = spec.find(\':\');",
+  "  if(colon == string::npos)",
+  "    return false;",
+  "  auto bound = [](const string &s, size_t fallback, size_t &v)",
+  "  {",
+  "    if(s.empty())",
+  "    {",
+  "      v = fallback;",
+  "      return true;",
+  "    }",
+  "    v = 0;",
+  "    for(char c : s)",
+  "    {",
+  "      if(c < \'0\' || c > \'9\' || v > (SIZE_MAX - 9) / 10)",
+  "        return false;",
+  "      v = v * 10 + (c - \'0\');",
+  "    }",
+  "    return true;",
+  "  };",
+  "  if(!bound(spec.substr(0, colon), 0, begin) || !bound(spec.substr(colon + 1), total, end))",
+  "    return false;",
+  "  end = min(end, total);",
+  "  begin = min(begin, end);",
+  "  return true;",
+  "}",
+  "",
+  "// Streams the rendered output through a VerifySink against the mapped",
+  "// source and reports the first diverging line and column.",
+  "template<class FillFunc>",
+  "int verifySource(const string &path, FillFunc fill)",
+  "{",
+  "  int fd = open(path.c_str(), O_RDONLY);",
+  "  struct stat st;",
+  "  if(fd < 0 || fstat(fd, &st) != 0)",
+  "  {",
+  "    cerr << \"error: cannot read \" << path << endl;",
+  "    return 1;",
+  "  }",
+  "  size_t size = st.st_size;",
+  "  void *map = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;",
+  "  close(fd);",
+  "  if(map == MAP_FAILED)",
+  "  {",
+  "    cerr << \"error: cannot map \" << path << endl;",
+  "    return 1;",
+  "  }",
+  "  string_view source(static_cast<const char*>(map), size);",
+  "  VerifySink sink(source);",
+  "  fill(sink);",
+  "  size_t at = sink.firstMismatch();",
+  "  if(at != string_view::npos)",
+  "  {",
+  "    // rfind from npos would search the whole file, so byte 0 is line 1.",
+  "    size_t lineStart = at == 0 ? string_view::npos : source.rfind(\'\\n\', at - 1);",
+  "    lineStart = lineStart == string_view::npos ? 0 : lineStart + 1;",
+  "    size_t line = 1 + count(source.begin(), source.begin() + lineStart, \'\\n\');",
+  "    cerr << path << \":\" << line << \":\" << at - lineStart + 1 << \": output diverges at byte \" << at",
+  "         << \" (\" << sink.bytes() << \" bytes rendered, \" << size << \" in source)\" << endl;",
+  "  }",
+  "  else",
+  "  {",
+  "    char digest[17];",
+  "    snprintf(digest, sizeof(digest), \"%016llx\", (unsigned long long) sink.digest());",
+  "    cout << path << \": ok, \" << size << \" bytes, fnv1a \" << digest << endl;",
+  "  }",
+  "  if(map)",
+  "    munmap(map, size);",
+  "  return at == string_view::npos ? 0 : 1;",
+  "}",
+  "",
+  "// The twelve code tables parsed back out of a rendered C++ Quine, in",
+  "// codeTables order, together with the version it was rendered with.",
+  "class ParsedQuine",
+  "{",
+  "  private:",
+  "    string            chars;",
+  "    vector<PoolSpan>  spans;",
+  "    size_t            first[13] = {};",
+  "    void unescape(string_view s)",
+  "    {",
+  "      for(size_t i = s.find(\'\\\\\'); i != string_view::npos; i = s.find(\'\\\\\'))",
+  "      {",
+  "        chars.append(s.data(), i);",
+  "        if(i + 1 < s.size())",
+  "          chars += s[i + 1];",
+  "        s.remove_prefix(min(i + 2, s.size()));",
+  "      }",
+  "      chars.append(s.data(), s.size());",
+  "    }",
+  "  public:",
+  "    string  version;",
+  "    bool parse(string_view text)",
+  "    {",
+  "      static const char *names[12] = {",
+  "        \"strPreCPP\", \"strClassesCPP\", \"strVarCPP\", \"strPostCPP\",",
+  "        \"strPrePYTHON\", \"strClassesPYTHON\", \"strVarPYTHON\", \"strPostPYTHON\",",
+  "        \"strPreSCHEME\", \"strClassesSCHEME\", \"strVarSCHEME\", \"strPostSCHEME\"",
+  "      };",
+  "      typedef LangPolicy<Language::CPP> Policy;",
+  "      chars.clear();",
+  "      spans.clear();",
+  "      chars.reserve(text.size());",
+  "",
+  "      size_t v = text.find(Policy::versionOpen);",
+  "      if(v == string_view::npos)",
+  "        return false;",
+  "      v += Policy::versionOpen.size();",
+  "      size_t vEnd = text.find(Policy::versionClose, v);",
+  "      if(vEnd == string_view::npos)",
+  "        return false;",
+  "      unescape(text.substr(v, vEnd - v));",
+  "      version = chars;",
+  "      chars.clear();",
+  "",
+  "      size_t pos = 0;",
+  "      for(size_t t = 0; t < 12; t++)",
+  "      {",
+  "        string header = string(\"\\nconstexpr string_view \") + names[t] + \"[] = {\\n\";",
+  "        pos = text.find(header, pos);",
+  "        if(pos == string_view::npos)",
+  "          return false;",
+  "        pos += header.size();",
+  "        first[t] = spans.size();",
+  "        for(;;)",
+  "        {",
+  "          size_t eol = text.find(\'\\n\', pos);",
+  "          if(eol == string_view::npos)",
+  "            return false;",
+  "          string_view line = text.substr(pos, eol - pos);",
+  "          pos = eol + 1;",
+  "          if(line == \"};\")",
+  "            break;",
+  "          if(line.substr(0, Policy::quoteOpen.size()) != Policy::quoteOpen)",
+  "            return false;",
+  "          line.remove_prefix(Policy::quoteOpen.size());",
+  "          if(!line.empty() && line.back() == \',\')",
+  "            line.remove_suffix(1);",
+  "          if(line.empty() || line.back() != \'\\\"\')",
+  "            return false;",
+  "          line.remove_suffix(1);",
+  "          size_t offset = chars.size();",
+  "          unescape(line);",
+  "          spans.push_back(PoolSpan { uint32_t(offset), uint32_t(chars.size() - offset) });",
+  "        }",
+  "      }",
+  "      first[12] = spans.size();",
+  "      return true;",
+  "    }",
+  "    Table table(size_t t) const",
+  "    {",
+  "      return Table(chars.data(), spans.data() + first[t], first[t + 1] - first[t]);",
+  "    }",
+  "};",
+  "",
+  "// Feeds the C++ output back into itself n times: every generation parses",
+  "// the previous one\'s tables, builds a fresh Quine from them and checks",
+  "// that it renders the previous output again.",
+  "int runGenerations(string_view gen0, size_t n)",
+  "{",
+  "  auto start = stats::Clock::now();",
+  "  ParsedQuine parsed;",
+  "  size_t bytes = 0;",
+  "  for(size_t g = 1; g <= n; g++)",
+  "  {",
+  "    if(!parsed.parse(gen0))",
+  "    {",
+  "      cerr << \"error: generation \" << g << \": cannot parse the tables back\" << endl;",
+  "      return 1;",
+  "    }",
+  "    Quine q(parsed.version);",
+  "    for(size_t l = 0; l < 3; l++)",
+  "      q.addLang(Language(l), parsed.table(4 * l), parsed.table(4 * l + 1), parsed.table(4 * l + 2), parsed.table(4 * l + 3));",
+  "    q.init();",
+  "    VerifySink check(gen0);",
+  "    q.renderTo(Language::CPP, check);",
+  "    size_t at = check.firstMismatch();",
+  "    if(at != string_view::npos)",
+  "    {",
+  "      size_t line = 1 + count(gen0.begin(), gen0.begin() + min(at, gen0.size()), \'\\n\');",
+  "      cerr << \"error: generation \" << g << \" drifts at line \" << line << \", byte \" << at << endl;",
+  "      return 1;",
+  "    }",
+  "    bytes += check.bytes();",
+  "  }",
+  "  double seconds = chrono::duration<double>(stats::Clock::now() - start).count();",
+  "  printf(\"%zu generations stable in %.3f ms, %.0f generations/s, %.1f MB/s\\n\",",
+  "         n, seconds * 1e3, n / seconds, bytes / seconds / 1e6);",
+  "  return 0;",
+  "}",
+  "",
   "int main(int argc, char const *argv[])",
   "{",
+  "  stats::enterMain();",
+  "#ifndef QUINE_STATIC_RENDER",
   "  auto q = Quine(version);",
-  "  q.addLang(Language::CPP, &strPreCPP, &strClassesCPP, &strVarCPP, &strPostCPP);",
-  "  q.addLang(Language::PYTHON, &strPrePYTHON, &strClassesPYTHON, &strVarPYTHON, &strPostPYTHON);",
-  "  q.addLang(Language::SCHEME, &strPreSCHEME, &strClassesSCHEME, &strVarSCHEME, &strPostSCHEME);",
+  "  q.addLang(Language::CPP,    codeTables[size_t(Language::CPP)]);",
+  "  q.addLang(Language::PYTHON, codeTables[size_t(Language::PYTHON)]);",
+  "  q.addLang(Language::SCHEME, codeTables[size_t(Language::SCHEME)]);",
   "  q.init();",
+  "#endif",
   "",
   "  Language lang;",
+  "  bool     all = false;",
+  "  bool     uring = false;",
+  "  bool     gather = false;",
+  "  string   outDir;",
+  "  string   outFile;",
+  "  string   range;",
+  "  string   verify;",
+  "  int      generations = 0;",
+  "  bool     memStats = false;",
+  "  bool     timeStats = false;",
   "",
   "  try ",
   "  {",
+  "    stats::Scope parse(stats::Parse);",
   "    TCLAP::CmdLine cmd(\"Multi-Language Quine\", \' \', version);",
-  "    TCLAP::SwitchArg lang_cpp(\"\", \"cpp\", \"Display C++11 Quine\");",
+  "    TCLAP::SwitchArg lang_cpp(\"\", \"cpp\", \"Display C++17 Quine\");",
   "    TCLAP::SwitchArg lang_python(\"\", \"python\", \"Display Python 2.7 Quine\");",
   "    TCLAP::SwitchArg lang_scheme(\"\", \"scheme\", \"Display Scheme (Racket) Quine\");",
+  "    TCLAP::SwitchArg lang_all(\"\", \"all\", \"Write every language\'s Quine to --outdir\");",
+  "    TCLAP::ValueArg<string> out_dir(\"\", \"outdir\", \"Output directory for --all\", false, \".\", \"DIR\");",
+  "    TCLAP::SwitchArg use_uring(\"\", \"uring\", \"Write output asynchronously through io_uring\");",
+  "    TCLAP::SwitchArg use_writev(\"\", \"writev\", \"Write output with writev straight from the templates\");",
+  "    TCLAP::ValueArg<string> out_file(\"\", \"output\", \"Write the Quine to FILE instead of stdout\", false, \"\", \"FILE\");",
+  "    TCLAP::SwitchArg mem_stats(\"\", \"mem-stats\", \"Print allocation statistics to stderr\");",
+  "    TCLAP::SwitchArg time_stats(\"\", \"stats\", \"Print per-phase timings to stderr\");",
+  "    TCLAP::ValueArg<string> verify_source(\"\", \"verify\", \"Check that the Quine reproduces SOURCE\", false, \"\", \"SOURCE\");",
+  "    TCLAP::ValueArg<int> gen_count(\"\", \"generations\", \"Rebuild the C++ Quine from its own output N times (needs --cpp)\", false, 0, \"N\");",
+  "    TCLAP::ValueArg<string> out_range(\"\", \"range\", \"Only write bytes A up to B of the Quine\", false, \"\", \"A:B\");",
   "    vector<TCLAP::Arg*> xorList = {",
   "      &lang_cpp,",
   "      &lang_python,",
-  "      &lang_scheme",
+  "      &lang_scheme,",
+  "      &lang_all",
   "    };",
   "    cmd.xorAdd(xorList);",
+  "    cmd.add(out_dir);",
+  "    cmd.add(use_uring);",
+  "    cmd.add(use_writev);",
+  "    cmd.add(out_file);",
+  "    cmd.add(out_range);",
+  "    cmd.add(verify_source);",
+  "    cmd.add(gen_count);",
+  "    cmd.add(mem_stats);",
+  "    cmd.add(time_stats);",
   "    cmd.parse(argc, argv);",
   "",
+  "    all = lang_all.getValue();",
+  "    outDir = out_dir.getValue();",
+  "    uring = use_uring.getValue();",
+  "    gather = use_writev.getValue();",
+  "    outFile = out_file.getValue();",
+  "    range = out_range.getValue();",
+  "    verify = verify_source.getValue();",
+  "    generations = gen_count.getValue();",
+  "    memStats = mem_stats.getValue();",
+  "    timeStats = time_stats.getValue();",
+  "",
   "    if(lang_cpp.getValue())",
   "      lang = Language::CPP;",
   "    else if(lang_python.getValue())",
@@ -503,7 +2487,120 @@ strPostCPP = [
   "    cerr << \"error: \" << e.error() << \" for arg \" << e.argId() << endl;",
   "  }",
   "",
-  "  q.print(lang);",
+  "  if(generations > 0 && (all || lang != Language::CPP))",
+  "  {",
+  "    cerr << \"error: --generations only rebuilds the C++ Quine, use it with --cpp\" << endl;",
+  "    return 1;",
+  "  }",
+  "",
+  "  if(memStats)",
+  "    atexit(stats::reportMemory);",
+  "  if(timeStats)",
+  "    atexit(stats::reportTiming);",
+  "  stats::Scope output(stats::Output);",
+  "",
+  "#ifdef QUINE_STATIC_RENDER",
+  "  vector<Language> langs = { Language::CPP, Language::PYTHON, Language::SCHEME };",
+  "  auto render = staticOutput;",
+  "  auto outputSize = [](Language l) { return staticOutput(l).size(); };",
+  "#else",
+  "  vector<Language> langs = q.getLanguages();",
+  "  // main never changes the version, so the cache keeps every render alive.",
+  "  auto render = [&](Language l) -> string_view { return *q.render(l); };",
+  "  auto outputSize = [&](Language l) { return q.outputSize(l); };",
+  "#endif",
+  "  if(all)",
+  "    for(Language l : langs)",
+  "      stats::emitted += outputSize(l);",
+  "  else",
+  "    stats::emitted = outputSize(lang);",
+  "  if(all && uring)",
+  "    return printAllUring(langs, outDir, render);",
+  "  if(all)",
+  "    return printAll(langs, outDir, render);",
+  "",
+  "  if(generations > 0)",
+  "  {",
+  "#ifdef QUINE_STATIC_RENDER",
+  "    return runGenerations(staticOutput(Language::CPP), generations);",
+  "#else",
+  "    return runGenerations(*q.render(Language::CPP), generations);",
+  "#endif",
+  "  }",
+  "",
+  "  if(!verify.empty())",
+  "  {",
+  "#ifdef QUINE_STATIC_RENDER",
+  "    return verifySource(verify, [&](OutputSink &out) { out.append(staticOutput(lang)); });",
+  "#else",
+  "    return verifySource(verify, [&](OutputSink &out) { q.renderTo(lang, out); });",
+  "#endif",
+  "  }",
+  "",
+  "  if(!range.empty())",
+  "  {",
+  "    size_t begin, end;",
+  "#ifdef QUINE_STATIC_RENDER",
+  "    string_view text = staticOutput(lang);",
+  "    if(parseRange(range, text.size(), begin, end))",
+  "    {",
+  "      stats::emitted = end - begin;",
+  "      return func::writeAll(STDOUT_FILENO, text.substr(begin, end - begin)) ? 0 : 1;",
+  "    }",
+  "#else",
+  "    if(parseRange(range, q.outputSize(lang), begin, end))",
+  "    {",
+  "      stats::emitted = end - begin;",
+  "      BufferedFdSink out(STDOUT_FILENO);",
+  "      q.renderRange(lang, begin, end - begin, out);",
+  "      out.flush();",
+  "      return out.good() ? 0 : 1;",
+  "    }",
+  "#endif",
+  "    cerr << \"error: invalid range \" << range << \", expected A:B\" << endl;",
+  "    return 1;",
+  "  }",
+  "",
+  "#ifdef QUINE_STATIC_RENDER",
+  "  if(!outFile.empty())",
+  "    return printToFile(outFile, staticOutput(lang).size(), [&](OutputSink &out) { out.append(staticOutput(lang)); });",
+  "  // The static image is a single buffer, so --writev has nothing to gather.",
+  "  (void) gather;",
+  "  if(uring)",
+  "  {",
+  "    UringWriter writer;",
+  "    writer.write(STDOUT_FILENO, staticOutput(lang), -1);",
+  "    return writer.wait() ? 0 : 1;",
+  "  }",
+  "  else if(!sendOutput(STDOUT_FILENO, staticOutput(lang)))",
+  "  {",
+  "    cerr << \"error: writing to standard output failed\" << endl;",
+  "    return 1;",
+  "  }",
+  "#else",
+  "  if(!outFile.empty())",
+  "    return printToFile(outFile, q.outputSize(lang), [&](OutputSink &out) { q.renderTo(lang, out); });",
+  "  if(gather)",
+  "  {",
+  "    IovecSink out(STDOUT_FILENO);",
+  "    q.renderTo(lang, out);",
+  "    out.flush();",
+  "    return out.good() ? 0 : 1;",
+  "  }",
+  "  if(uring)",
+  "  {",
+  "    UringWriter writer;",
+  "    UringSink out(writer, STDOUT_FILENO);",
+  "    q.renderTo(lang, out);",
+  "    out.flush();",
+  "    return out.good() ? 0 : 1;",
+  "  }",
+  "  else if(printZeroCopy(STDOUT_FILENO, q.outputSize(lang), [&](OutputSink &out) { q.renderTo(lang, out); }) != 0)",
+  "  {",
+  "    cerr << \"error: writing to standard output failed\" << endl;",
+  "    return 1;",
+  "  }",
+  "#endif",
   "",
   "  return 0;",
   "}",
@@ -515,7 +2612,7 @@ strPrePYTHON = [
   "#",
   "# Multi-Language Quine",
   "# Author: Nina Alexandra Klama",
-  "# Languages: C++11, Python 2.7, Scheme (Racket)",
+  "# Languages: C++17, Python 2.7, Scheme (Racket)",
   "#",
   "",
   "import argparse",
@@ -647,7 +2744,7 @@ strClassesPYTHON = [
   "",
   "  def init(self):",
   "    replVersion = ReplaceVariableString(\"###VERSION###\", self.version)",
-  "    replVersion.setString(\"CPP\",    \"string version = \\\"\", \"\\\";\")",
+  "    replVersion.setString(\"CPP\",    \"constexpr char version[] = \\\"\", \"\\\";\")",
   "    replVersion.setString(\"PYTHON\", \"version = \\\"\",\"\\\"\")",
   "    replVersion.setString(\"SCHEME\", \"(define version \\\"\",\"\\\")\")",
   "    self.COPre.addReplacement(replVersion)",
@@ -755,7 +2852,7 @@ strPostPYTHON = [
   "  q.init()",
   "",
   "  argParser = argparse.ArgumentParser(description=\"Multi-Language Quine %s\" % version)",
-  "  argParser.add_argument(\'--cpp\',    action=\"store_true\", help=\"Display C++11 Quine\")",
+  "  argParser.add_argument(\'--cpp\',    action=\"store_true\", help=\"Display C++17 Quine\")",
   "  argParser.add_argument(\'--python\', action=\"store_true\", help=\"Display Python 2.7 Quine\")",
   "  argParser.add_argument(\'--scheme\', action=\"store_true\", help=\"Display Scheme (Racket) Quine\")",
   "  args = vars(argParser.parse_args())",
@@ -785,7 +2882,7 @@ strPreSCHEME = [
   "; ",
   "; Multi-Language Quine",
   "; Author: Nina Alexandra Klama",
-  "; Languages: C++11, Python 2.7, Scheme (Racket)",
+  "; Languages: C++17, Python 2.7, Scheme (Racket)",
   "; ",
   "",
   "(require racket/cmdline)",
@@ -946,7 +3043,7 @@ strPostSCHEME = [
   "(define versReplacer",
   "  (Version \"###VERSION###\" \"version\"",
   "    (hash",
-  "      \"CPP\"    (VersData \"string version = \\\"\" \"\\\";\")",
+  "      \"CPP\"    (VersData \"constexpr char version[] = \\\"\" \"\\\";\")",
   "      \"PYTHON\" (VersData \"version = \\\"\" \"\\\"\")",
   "      \"SCHEME\" (VersData \"(define version \\\"\" \"\\\")\") )))",
   "",
@@ -992,7 +3089,7 @@ strPostSCHEME = [
   "    (display version)",
   "    (newline)(newline)",
   "    (display \"optional arguments:\")(newline)",
-  "    (display \"  --cpp      Display C++11 Quine\")(newline)",
+  "    (display \"  --cpp      Display C++17 Quine\")(newline)",
   "    (display \"  --python   Display Python 2.7 Quine\")(newline)",
   "    (display \"  --scheme   Display Scheme (Racket) Quine\")(newline)",
   "    (exit)))",
@@ -1026,7 +3123,7 @@ if __name__ == "__main__":
   q.init()
 
   argParser = argparse.ArgumentParser(description="Multi-Language Quine %s" % version)
-  argParser.add_argument('--cpp',    action="store_true", help="Display C++11 Quine")
+  argParser.add_argument('--cpp',    action="store_true", help="Display C++17 Quine")
   argParser.add_argument('--python', action="store_true", help="Display Python 2.7 Quine")
   argParser.add_argument('--scheme', action="store_true", help="Display Scheme (Racket) Quine")
   args = vars(argParser.parse_args())
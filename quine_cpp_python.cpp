@@ -10,6 +10,8 @@ using namespace std;
 #include <string>
 #include <vector>
 #include <map>
+#include <cerrno>
+#include <unistd.h>
 #include <tclap/CmdLine.h>
 
 enum class Language {
@@ -42,6 +44,43 @@ namespace func
   }
 }
 
+class OutputSink
+{
+  public:
+    virtual ~OutputSink() {}
+    virtual void append(const string &line) = 0;
+    virtual void flush() = 0;
+};
+
+class BufferedFdSink : public OutputSink
+{
+  private:
+    int     fd;
+    string  buffer;
+  public:
+    BufferedFdSink(int f = STDOUT_FILENO) : fd(f) {}
+    ~BufferedFdSink() { flush(); }
+    void append(const string &line)
+    {
+      buffer += line;
+      buffer += '\n';
+    }
+    void flush()
+    {
+      size_t done = 0;
+      while(done < buffer.size())
+      {
+        ssize_t n = write(fd, buffer.data() + done, buffer.size() - done);
+        if(n < 0 && errno == EINTR)
+          continue;
+        if(n <= 0)
+          break;
+        done += n;
+      }
+      buffer.clear();
+    }
+};
+
 class ReplaceObject
 {
   public:
@@ -204,16 +243,22 @@ class Quine
       COVar.addReplacement(replVarPYTHON);
       COVar.addReplacement(replPostPYTHON);
     }
+    void print(Language l, OutputSink &out)
+    {
+      for(const string &c : COPre.returnCode(l))
+        out.append(c);
+      for(const string &c : COClasses.returnCode(l))
+        out.append(c);
+      for(const string &c : COVar.returnCode(l))
+        out.append(c);
+      for(const string &c : COPost.returnCode(l))
+        out.append(c);
+      out.flush();
+    }
     void print(Language l)
     {
-      for(string c : COPre.returnCode(l))
-        cout << c << endl;
-      for(string c : COClasses.returnCode(l))
-        cout << c << endl;
-      for(string c : COVar.returnCode(l))
-        cout << c << endl;
-      for(string c : COPost.returnCode(l))
-        cout << c << endl;
+      BufferedFdSink out(STDOUT_FILENO);
+      print(l, out);
     }
 };
 
@@ -230,6 +275,8 @@ vector<string> strPreCPP = {
   "#include <string>",
   "#include <vector>",
   "#include <map>",
+  "#include <cerrno>",
+  "#include <unistd.h>",
   "#include <tclap/CmdLine.h>",
   "",
   "enum class Language {",
@@ -265,6 +312,43 @@ vector<string> strPreCPP = {
 };
 
 vector<string> strClassesCPP = {
+  "class OutputSink",
+  "{",
+  "  public:",
+  "    virtual ~OutputSink() {}",
+  "    virtual void append(const string &line) = 0;",
+  "    virtual void flush() = 0;",
+  "};",
+  "",
+  "class BufferedFdSink : public OutputSink",
+  "{",
+  "  private:",
+  "    int     fd;",
+  "    string  buffer;",
+  "  public:",
+  "    BufferedFdSink(int f = STDOUT_FILENO) : fd(f) {}",
+  "    ~BufferedFdSink() { flush(); }",
+  "    void append(const string &line)",
+  "    {",
+  "      buffer += line;",
+  "      buffer += \'\\n\';",
+  "    }",
+  "    void flush()",
+  "    {",
+  "      size_t done = 0;",
+  "      while(done < buffer.size())",
+  "      {",
+  "        ssize_t n = write(fd, buffer.data() + done, buffer.size() - done);",
+  "        if(n < 0 && errno == EINTR)",
+  "          continue;",
+  "        if(n <= 0)",
+  "          break;",
+  "        done += n;",
+  "      }",
+  "      buffer.clear();",
+  "    }",
+  "};",
+  "",
   "class ReplaceObject",
   "{",
   "  public:",
@@ -427,16 +511,22 @@ vector<string> strClassesCPP = {
   "      COVar.addReplacement(replVarPYTHON);",
   "      COVar.addReplacement(replPostPYTHON);",
   "    }",
+  "    void print(Language l, OutputSink &out)",
+  "    {",
+  "      for(const string &c : COPre.returnCode(l))",
+  "        out.append(c);",
+  "      for(const string &c : COClasses.returnCode(l))",
+  "        out.append(c);",
+  "      for(const string &c : COVar.returnCode(l))",
+  "        out.append(c);",
+  "      for(const string &c : COPost.returnCode(l))",
+  "        out.append(c);",
+  "      out.flush();",
+  "    }",
   "    void print(Language l)",
   "    {",
-  "      for(string c : COPre.returnCode(l))",
-  "        cout << c << endl;",
-  "      for(string c : COClasses.returnCode(l))",
-  "        cout << c << endl;",
-  "      for(string c : COVar.returnCode(l))",
-  "        cout << c << endl;",
-  "      for(string c : COPost.returnCode(l))",
-  "        cout << c << endl;",
+  "      BufferedFdSink out(STDOUT_FILENO);",
+  "      print(l, out);",
   "    }",
   "};",
   ""